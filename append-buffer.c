@@ -1,10 +1,12 @@
 #include "append-buffer.h"
+#include "perf.h"
 #include <stdlib.h>
 #include <string.h>
 
 #define append_buffer_init {NULL, 0};
 
 void append_buffer_append(struct append_buffer *ab, char *string, int length) {
+  editorPerfCount(PERF_REALLOCS);
   char *longerBuffer = realloc(ab->b, ab->length + length);
 
   if (longerBuffer == NULL) {
@@ -0,0 +1,324 @@
+#include "append-buffer.h"
+#include "clipboard.h"
+#include "editor.h"
+#include "util.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+// Headless benchmarks for the core editing operations.
+//
+// usage: kilo-bench [scale]
+//
+// Each line of output is a JSON object describing one operation on one corpus:
+// throughput, latency percentiles (in nanoseconds), how many allocations the
+// operation made, and the peak resident set size of the process so far.
+
+#define BENCH_EDIT_OPS 20000
+#define BENCH_DRAW_OPS 2000
+#define BENCH_OPEN_OPS 3
+#define BENCH_SAVE_OPS 3
+
+#pragma mark - Allocation counting
+
+// count every allocation by wrapping the C library's allocator; only glibc
+// exposes the underlying functions, so elsewhere allocations read as 0
+static uint64_t allocations = 0;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size) {
+  allocations++;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  allocations++;
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) {
+  allocations++;
+  return __libc_realloc(pointer, size);
+}
+#endif
+
+#pragma mark - Measurement
+
+struct BenchResult {
+  const char *corpus;
+  const char *op;
+  uint64_t *latencies;
+  int count;
+  uint64_t allocations;
+};
+
+uint64_t benchNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// a small deterministic generator, so every run edits the same places
+uint64_t benchRandom(void) {
+  static uint64_t state = 0x9E3779B97F4A7C15ULL;
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+int compareLatencies(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+long benchPeakRssKb(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  // macOS reports bytes, Linux kilobytes
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+void benchBegin(struct BenchResult *result, const char *corpus, const char *op,
+                int capacity) {
+  result->corpus = corpus;
+  result->op = op;
+  result->latencies = malloc(sizeof(uint64_t) * capacity);
+  result->count = 0;
+  result->allocations = allocations;
+}
+
+void benchRecord(struct BenchResult *result, uint64_t start) {
+  result->latencies[result->count++] = benchNow() - start;
+}
+
+void benchReport(struct BenchResult *result) {
+  uint64_t allocation_count = allocations - result->allocations;
+  uint64_t total = 0;
+  for (int j = 0; j < result->count; j++) {
+    total += result->latencies[j];
+  }
+  qsort(result->latencies, result->count, sizeof(uint64_t), compareLatencies);
+
+  uint64_t *l = result->latencies;
+  int n = result->count;
+  printf("{\"corpus\":\"%s\",\"op\":\"%s\",\"ops\":%d,\"ops_per_sec\":%.1f,"
+         "\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu,"
+         "\"allocs\":%llu,\"allocs_per_op\":%.2f,\"peak_rss_kb\":%ld}\n",
+         result->corpus, result->op, n,
+         total ? n / (total / 1e9) : 0.0, (unsigned long long)l[n * 50 / 100],
+         (unsigned long long)l[n * 90 / 100],
+         (unsigned long long)l[n * 99 / 100], (unsigned long long)l[n - 1],
+         (unsigned long long)allocation_count, (double)allocation_count / n,
+         benchPeakRssKb());
+  fflush(stdout);
+  free(result->latencies);
+}
+
+#pragma mark - Corpora
+
+struct BenchCorpus {
+  const char *name;
+  // how many lines to write, and a generator for each
+  int lines;
+  void (*write_line)(FILE *fp, int line);
+};
+
+void writeProseLine(FILE *fp, int line) {
+  fprintf(fp, "%08d the quick brown fox jumps over the lazy dog %llu\n", line,
+          (unsigned long long)(benchRandom() % 1000000));
+}
+
+void writeLongLine(FILE *fp, int line) {
+  for (int j = 0; j < 2000; j++) {
+    fputc('a' + (line + j) % 26, fp);
+    if (j % 40 == 39) {
+      fputc(' ', fp);
+    }
+  }
+  fputc('\n', fp);
+}
+
+void writeTabLine(FILE *fp, int line) {
+  for (int j = 0; j < line % 12; j++) {
+    fputc('\t', fp);
+  }
+  fprintf(fp, "if (x)\t{\treturn\t%d;\t}\t// tab\tseparated\n", line);
+}
+
+void benchWriteCorpus(struct BenchCorpus *corpus, char *path) {
+  FILE *fp = fopen(path, "w");
+  if (!fp) {
+    die("could not create benchmark corpus.");
+  }
+  for (int j = 0; j < corpus->lines; j++) {
+    corpus->write_line(fp, j);
+  }
+  fclose(fp);
+}
+
+#pragma mark - Benchmarks
+
+// tear the editor down completely, so nothing one scenario built up (undo
+// history, indexes, the clipboard) is carried into the next one's numbers
+void benchReset(void) {
+  editorClose();
+  editorClipboardClear();
+  editorInit();
+  config.wsize.ws_row = 50;
+  config.wsize.ws_col = 200;
+}
+
+void benchOpen(const char *corpus, const char *op, char *path) {
+  struct BenchResult result;
+  benchBegin(&result, corpus, op, BENCH_OPEN_OPS);
+  for (int j = 0; j < BENCH_OPEN_OPS; j++) {
+    benchReset();
+    uint64_t start = benchNow();
+    editorOpen(path);
+    benchRecord(&result, start);
+  }
+  benchReport(&result);
+}
+
+void benchInsertRow(const char *corpus) {
+  char line[] = "a freshly inserted row\twith a tab";
+  struct BenchResult result;
+  benchBegin(&result, corpus, "insert_row", BENCH_EDIT_OPS);
+  for (int j = 0; j < BENCH_EDIT_OPS; j++) {
+    int at = (int)(benchRandom() % (config.row_count + 1));
+    uint64_t start = benchNow();
+    editorInsertRow(at, line, sizeof(line) - 1);
+    benchRecord(&result, start);
+  }
+  benchReport(&result);
+}
+
+void benchRowInsertChar(const char *corpus) {
+  struct BenchResult result;
+  benchBegin(&result, corpus, "row_insert_char", BENCH_EDIT_OPS);
+  for (int j = 0; j < BENCH_EDIT_OPS; j++) {
+    EditorRow *row = &config.rows[benchRandom() % config.row_count];
+    int at = (int)(benchRandom() % (row->size + 1));
+    uint64_t start = benchNow();
+    editorRowInsertChar(row, at, 'x');
+    benchRecord(&result, start);
+  }
+  benchReport(&result);
+}
+
+void benchDeleteChar(const char *corpus) {
+  struct BenchResult result;
+  benchBegin(&result, corpus, "delete_char", BENCH_EDIT_OPS);
+  for (int j = 0; j < BENCH_EDIT_OPS; j++) {
+    config.cy = (int)(benchRandom() % config.row_count);
+    config.cx = (int)(benchRandom() % (config.rows[config.cy].size + 1));
+    uint64_t start = benchNow();
+    editorDeleteChar();
+    benchRecord(&result, start);
+  }
+  benchReport(&result);
+}
+
+void benchDrawRows(const char *corpus) {
+  struct BenchResult result;
+  benchBegin(&result, corpus, "draw_rows", BENCH_DRAW_OPS);
+  for (int j = 0; j < BENCH_DRAW_OPS; j++) {
+    config.row_offset = (int)(benchRandom() % config.row_count);
+    config.col_offset = (int)(benchRandom() % 64);
+    struct append_buffer ab = append_buffer_init;
+    uint64_t start = benchNow();
+    editorDrawRows(&ab);
+    benchRecord(&result, start);
+    append_buffer_free(&ab);
+  }
+  config.row_offset = 0;
+  config.col_offset = 0;
+  benchReport(&result);
+}
+
+void benchSave(const char *corpus, char *path) {
+  struct BenchResult result;
+  benchBegin(&result, corpus, "save", BENCH_SAVE_OPS);
+  free(config.filename);
+  config.filename = strdup(path);
+  for (int j = 0; j < BENCH_SAVE_OPS; j++) {
+    uint64_t start = benchNow();
+    editorSave();
+    benchRecord(&result, start);
+  }
+  benchReport(&result);
+}
+
+void benchCorpus(struct BenchCorpus *corpus, char *directory) {
+  char path[4096], save_path[4096];
+  snprintf(path, sizeof(path), "%s/%s.txt", directory, corpus->name);
+  snprintf(save_path, sizeof(save_path), "%s/%s.saved.txt", directory,
+           corpus->name);
+  benchWriteCorpus(corpus, path);
+
+  // the first open scans the file and writes the line cache; later opens of
+  // the unchanged file are served from it
+  struct BenchResult result;
+  benchBegin(&result, corpus->name, "open", 1);
+  benchReset();
+  uint64_t start = benchNow();
+  editorOpen(path);
+  benchRecord(&result, start);
+  benchReport(&result);
+  benchOpen(corpus->name, "open_cached", path);
+
+  benchInsertRow(corpus->name);
+  benchRowInsertChar(corpus->name);
+  benchDeleteChar(corpus->name);
+  benchDrawRows(corpus->name);
+  benchSave(corpus->name, save_path);
+
+  benchReset();
+  unlink(path);
+  unlink(save_path);
+}
+
+int main(int argc, char *argv[]) {
+  int scale = argc >= 2 ? atoi(argv[1]) : 1;
+  if (scale < 1) {
+    fprintf(stderr, "usage: %s [scale]\n", argv[0]);
+    return 1;
+  }
+
+  char directory[] = "/tmp/kilo-bench-XXXXXX";
+  if (mkdtemp(directory) == NULL) {
+    die("could not create benchmark directory.");
+  }
+  // keep line caches out of the user's cache directory
+  setenv("XDG_CACHE_HOME", directory, 1);
+
+  struct BenchCorpus corpora[] = {
+      {"huge", 400000 * scale, writeProseLine},
+      {"long_lines", 2000 * scale, writeLongLine},
+      {"tabs", 200000 * scale, writeTabLine},
+  };
+
+  editorInit();
+  for (size_t j = 0; j < sizeof(corpora) / sizeof(corpora[0]); j++) {
+    benchCorpus(&corpora[j], directory);
+  }
+
+  char command[4200];
+  snprintf(command, sizeof(command), "rm -rf '%s'", directory);
+  return system(command) == 0 ? 0 : 1;
+}
@@ -0,0 +1,418 @@
+#include "brackets.h"
+#include "parallel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct BracketSummary {
+  // unmatched closing brackets, then unmatched opening ones
+  int closes;
+  int opens;
+};
+
+struct EditorFold {
+  // the hidden rows, [first, last]; row first - 1 opens the block
+  int first;
+  int last;
+};
+
+int editorBracketsIsOpening(char c) { return c == '(' || c == '[' || c == '{'; }
+
+int editorBracketsIsClosing(char c) { return c == ')' || c == ']' || c == '}'; }
+
+#pragma mark - Index
+
+// a's rows followed by b's: a's opening brackets match b's closing ones
+struct BracketSummary editorBracketsCombine(struct BracketSummary a,
+                                            struct BracketSummary b) {
+  int matched = a.opens < b.closes ? a.opens : b.closes;
+  struct BracketSummary combined = {a.closes + b.closes - matched,
+                                    a.opens + b.opens - matched};
+  return combined;
+}
+
+// count the brackets `row` leaves unmatched
+void editorBracketsCount(EditorRow *row) {
+  int closes = 0, opens = 0;
+  for (char *c = row->chars, *end = row->chars + row->size; c < end; c++) {
+    switch (*c) {
+    case '(':
+    case '[':
+    case '{':
+      opens++;
+      break;
+    case ')':
+    case ']':
+    case '}':
+      if (opens > 0) {
+        opens--;
+      } else {
+        closes++;
+      }
+      break;
+    }
+  }
+  row->bracket_closes = closes;
+  row->bracket_opens = opens;
+}
+
+// the index's summary of a row is what it leaves unmatched, counted now if it
+// hasn't been already
+void editorBracketsSummarize(void *summary, int row) {
+  EditorRow *r = &config.rows[row];
+  if (r->bracket_closes == -1) {
+    editorBracketsCount(r);
+  }
+  struct BracketSummary *s = summary;
+  s->closes = r->bracket_closes;
+  s->opens = r->bracket_opens;
+}
+
+void editorBracketsCombineInto(void *into, const void *next) {
+  struct BracketSummary *a = into;
+  *a = editorBracketsCombine(*a, *(const struct BracketSummary *)next);
+}
+
+void editorBracketsInit(void) {
+  editorRowTreeInit(&config.bracket_index, sizeof(struct BracketSummary),
+                    editorBracketsSummarize, editorBracketsCombineInto);
+}
+
+// count rows [begin, end) of `rows` that haven't been counted yet
+void editorBracketsCountRows(void *context, int begin, int end) {
+  EditorRow *rows = context;
+  for (int j = begin; j < end; j++) {
+    if (rows[j].bracket_closes == -1) {
+      editorBracketsCount(&rows[j]);
+    }
+  }
+}
+
+// Build the index the first time it's needed. The rows not yet counted are
+// counted on all cores first, so building it only reads their counts.
+void editorBracketsEnsureIndex(void) {
+  if (editorRowTreeBuilt(&config.bracket_index)) {
+    return;
+  }
+  editorParallelFor(editorParallelWorkers(config.row_count), config.row_count,
+                    editorBracketsCountRows, config.rows);
+  editorRowTreeBuild(&config.bracket_index, config.row_count);
+}
+
+void editorBracketsRowsSpliced(int at, int remove_count, int add_count) {
+  if (editorRowTreeBuilt(&config.bracket_index)) {
+    editorRowTreeSplice(&config.bracket_index, at, remove_count, add_count);
+  }
+}
+
+void editorBracketsRowUpdated(EditorRow *row) {
+  row->bracket_closes = -1;
+  // rows are counted when the index is next needed, unless it's built and
+  // this row is in it (rather than, say, in an undo record)
+  if (!editorRowTreeBuilt(&config.bracket_index) || row < config.rows ||
+      row >= config.rows + config.row_count) {
+    return;
+  }
+  editorRowTreeUpdate(&config.bracket_index, (int)(row - config.rows));
+}
+
+#pragma mark - Matching
+
+// Find the first row at or after `from` where `*depth` open brackets are
+// closed, searching the subtree at `node`, whose first row is `low`. Returns
+// -1 if it isn't there, after taking the subtree's brackets into `*depth`.
+int editorBracketsFindClose(int node, int low, int from, int *depth) {
+  struct RowTree *tree = &config.bracket_index;
+  if (node == 0 || low + tree->nodes[node].size <= from) {
+    return -1;
+  }
+  struct BracketSummary *summary = editorRowTreeSummary(tree, node);
+  if (low >= from && summary->closes < *depth) {
+    *depth += summary->opens - summary->closes;
+    return -1;
+  }
+
+  int left = tree->nodes[node].left;
+  int row = editorBracketsFindClose(left, low, from, depth);
+  if (row != -1) {
+    return row;
+  }
+  row = low + tree->nodes[left].size;
+  if (row >= from) {
+    struct BracketSummary *own = editorRowTreeRowSummary(tree, node);
+    if (own->closes >= *depth) {
+      return row;
+    }
+    *depth += own->opens - own->closes;
+  }
+  return editorBracketsFindClose(tree->nodes[node].right, row + 1, from, depth);
+}
+
+// Find the last row at or before `to` where `*depth` close brackets are
+// opened, searching backwards; otherwise like editorBracketsFindClose.
+int editorBracketsFindOpen(int node, int low, int to, int *depth) {
+  struct RowTree *tree = &config.bracket_index;
+  if (node == 0 || low > to) {
+    return -1;
+  }
+  struct BracketSummary *summary = editorRowTreeSummary(tree, node);
+  if (low + tree->nodes[node].size - 1 <= to && summary->opens < *depth) {
+    *depth += summary->closes - summary->opens;
+    return -1;
+  }
+
+  int left = tree->nodes[node].left;
+  int middle = low + tree->nodes[left].size;
+  int row =
+      editorBracketsFindOpen(tree->nodes[node].right, middle + 1, to, depth);
+  if (row != -1) {
+    return row;
+  }
+  if (middle <= to) {
+    struct BracketSummary *own = editorRowTreeRowSummary(tree, node);
+    if (own->opens >= *depth) {
+      return middle;
+    }
+    *depth += own->closes - own->opens;
+  }
+  return editorBracketsFindOpen(left, low, to, depth);
+}
+
+// Scan `row` from `from` towards its end (direction 1) or start (direction
+// -1) for where `*depth` brackets are matched. Returns -1 if they aren't, after
+// taking the row's brackets into `*depth`.
+int editorBracketsScan(EditorRow *row, int from, int direction, int *depth) {
+  for (int j = from; j >= 0 && j < row->size; j += direction) {
+    char c = row->chars[j];
+    if (editorBracketsIsOpening(c) || editorBracketsIsClosing(c)) {
+      int deeper = editorBracketsIsOpening(c) == (direction > 0);
+      *depth += deeper ? 1 : -1;
+      if (*depth == 0) {
+        return j;
+      }
+    }
+  }
+  return -1;
+}
+
+// Find the bracket matching the one at (x, y). Returns 0 if there's none.
+int editorBracketsMatch(int x, int y, int *match_x, int *match_y) {
+  EditorRow *row = &config.rows[y];
+  int direction = editorBracketsIsOpening(row->chars[x]) ? 1 : -1;
+  int depth = 1;
+  int found = editorBracketsScan(row, x + direction, direction, &depth);
+  if (found != -1) {
+    *match_x = found;
+    *match_y = y;
+    return 1;
+  }
+
+  // the rest of the way is through the index
+  editorBracketsEnsureIndex();
+  int root = config.bracket_index.root;
+  y = direction > 0 ? editorBracketsFindClose(root, 0, y + 1, &depth)
+                    : editorBracketsFindOpen(root, 0, y - 1, &depth);
+  if (y == -1) {
+    return 0;
+  }
+  row = &config.rows[y];
+  *match_x = editorBracketsScan(row, direction > 0 ? 0 : row->size - 1,
+                                direction, &depth);
+  *match_y = y;
+  return 1;
+}
+
+void editorBracketsJump(void) {
+  EditorRow *row =
+      config.cy < config.row_count ? &config.rows[config.cy] : NULL;
+  if (row == NULL || config.cx >= row->size ||
+      !(editorBracketsIsOpening(row->chars[config.cx]) ||
+        editorBracketsIsClosing(row->chars[config.cx]))) {
+    editorSetStatusMessage("No bracket under the cursor.");
+    return;
+  }
+
+  int x, y;
+  if (!editorBracketsMatch(config.cx, config.cy, &x, &y)) {
+    editorSetStatusMessage("No matching bracket.");
+    return;
+  }
+  char pair[] = "()[]{}";
+  char *bracket = strchr(pair, row->chars[config.cx]);
+  char expected = pair[(bracket - pair) ^ 1];
+  if (config.rows[y].chars[x] != expected) {
+    editorSetStatusMessage("Mismatched bracket: %c", config.rows[y].chars[x]);
+  }
+  config.cx = x;
+  config.cy = y;
+  editorFoldsReveal(y);
+}
+
+#pragma mark - Folding
+
+int editorFoldsActive(void) { return config.fold_count > 0 && !config.wrap; }
+
+// the last fold starting at or before `row`, or -1
+int editorFoldsFind(int row) {
+  int low = 0, high = config.fold_count;
+  while (low < high) {
+    int middle = low + (high - low) / 2;
+    if (config.folds[middle].first <= row) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low - 1;
+}
+
+void editorFoldsRemove(int index) {
+  memmove(&config.folds[index], &config.folds[index + 1],
+          sizeof(struct EditorFold) * (config.fold_count - index - 1));
+  config.fold_count--;
+}
+
+// hide rows [first, last], replacing any folds among them
+void editorFoldsAdd(int first, int last) {
+  int index = editorFoldsFind(last);
+  while (index >= 0 && config.folds[index].last >= first) {
+    editorFoldsRemove(index--);
+  }
+  if (config.fold_count == config.fold_capacity) {
+    config.fold_capacity = config.fold_capacity ? config.fold_capacity * 2 : 8;
+    config.folds = realloc(config.folds,
+                           sizeof(struct EditorFold) * config.fold_capacity);
+  }
+  index++;
+  memmove(&config.folds[index + 1], &config.folds[index],
+          sizeof(struct EditorFold) * (config.fold_count - index));
+  config.folds[index].first = first;
+  config.folds[index].last = last;
+  config.fold_count++;
+}
+
+void editorFoldToggle(void) {
+  if (config.wrap) {
+    editorSetStatusMessage("Folds are hidden while soft wrap is on.");
+    return;
+  }
+  if (config.cy >= config.row_count) {
+    editorSetStatusMessage("No block starts on this line.");
+    return;
+  }
+
+  int index = editorFoldsFind(config.cy + 1);
+  if (index != -1 && config.folds[index].first == config.cy + 1) {
+    int count = config.folds[index].last - config.folds[index].first + 1;
+    editorFoldsRemove(index);
+    editorSetStatusMessage("Unfolded %d lines.", count);
+    return;
+  }
+
+  // fold the block opened by the last bracket the line leaves open
+  editorBracketsEnsureIndex();
+  EditorRow *row = &config.rows[config.cy];
+  if (row->bracket_opens == 0) {
+    editorSetStatusMessage("No block starts on this line.");
+    return;
+  }
+  int depth = 1;
+  int x = editorBracketsScan(row, row->size - 1, -1, &depth);
+  int match_x, match_y;
+  if (!editorBracketsMatch(x, config.cy, &match_x, &match_y)) {
+    editorSetStatusMessage("No matching bracket.");
+    return;
+  }
+  if (match_y - config.cy < 2) {
+    editorSetStatusMessage("Nothing to fold.");
+    return;
+  }
+  editorFoldsAdd(config.cy + 1, match_y - 1);
+  editorSetStatusMessage("Folded %d lines.", match_y - config.cy - 1);
+}
+
+void editorFoldsRowsMoved(int at, int remove_count, int add_count) {
+  for (int j = 0; j < config.fold_count; j++) {
+    struct EditorFold *fold = &config.folds[j];
+    if (fold->last < at) {
+      continue;
+    }
+    if (fold->first - 1 >= at + remove_count) {
+      fold->first += add_count - remove_count;
+      fold->last += add_count - remove_count;
+    } else {
+      editorFoldsRemove(j--);
+    }
+  }
+}
+
+void editorFoldsClear(void) {
+  free(config.folds);
+  config.folds = NULL;
+  config.fold_count = 0;
+  config.fold_capacity = 0;
+}
+
+void editorFoldsReveal(int row) {
+  int index = editorFoldsFind(row);
+  if (index != -1 && row <= config.folds[index].last) {
+    editorFoldsRemove(index);
+  }
+}
+
+int editorFoldsVisibleRow(int row, int direction) {
+  if (!editorFoldsActive()) {
+    return row;
+  }
+  int index = editorFoldsFind(row);
+  if (index == -1 || row > config.folds[index].last) {
+    return row;
+  }
+  // folds never touch, since the closing line of each is shown
+  return direction > 0 ? config.folds[index].last + 1
+                       : config.folds[index].first - 1;
+}
+
+int editorFoldsStep(int row, int count) {
+  int direction = count < 0 ? -1 : 1;
+  for (; count != 0; count -= direction) {
+    row = editorFoldsVisibleRow(row + direction, direction);
+  }
+  return row;
+}
+
+int editorFoldsVisibleBetween(int from, int to) {
+  int count = to - from;
+  if (!editorFoldsActive()) {
+    return count;
+  }
+  for (int j = 0; j < config.fold_count; j++) {
+    int first = config.folds[j].first > from ? config.folds[j].first : from;
+    int last = config.folds[j].last < to - 1 ? config.folds[j].last : to - 1;
+    if (first <= last) {
+      count -= last - first + 1;
+    }
+  }
+  return count;
+}
+
+void editorFoldsDrawMarker(struct append_buffer *ab, int filerow,
+                           int available) {
+  if (!editorFoldsActive()) {
+    return;
+  }
+  int index = editorFoldsFind(filerow + 1);
+  if (index == -1 || config.folds[index].first != filerow + 1) {
+    return;
+  }
+  char marker[32];
+  int length = snprintf(marker, sizeof(marker), " [%d lines]",
+                        config.folds[index].last - config.folds[index].first + 1);
+  if (length > available) {
+    length = available;
+  }
+  if (length > 0) {
+    append_buffer_append(ab, marker, length);
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef brackets_h
+#define brackets_h
+
+#include "append-buffer.h"
+#include "editor.h"
+
+// Brackets: jumping to the matching bracket, and folding away the lines
+// between a pair.
+//
+// Each row counts the brackets it leaves unmatched: closing ones, then opening
+// ones (`) x) ( ((` is 2 and 3). A row tree combines the counts over runs of
+// rows, so a match many lines away is found by descending the tree in
+// O(log n) rather than scanning the text in between. Rows are first counted
+// when the tree is first needed, not when the file is read. After that,
+// editing a row recounts it and patches its path through the tree, and adding
+// or removing rows splices the tree in O(log n), counting only the new rows.
+//
+// (), [] and {} nest as one, and brackets in strings and comments count too.
+
+// Set up the calling thread's (empty) index.
+void editorBracketsInit(void);
+// Tell the index that `row`'s text changed.
+void editorBracketsRowUpdated(EditorRow *row);
+// Tell the index that rows [at, at + remove_count) were replaced with
+// `add_count` rows, which are now in place.
+void editorBracketsRowsSpliced(int at, int remove_count, int add_count);
+
+// Move the cursor to the bracket matching the one under it.
+void editorBracketsJump(void);
+
+// Folding hides the lines inside a bracket pair, leaving the lines with the
+// brackets on them. Hidden rows are skipped when drawing and moving the
+// cursor; with soft wrap on, every row is shown.
+
+// Fold the block opened on the cursor's line, or unfold it if it's folded.
+void editorFoldToggle(void);
+// Rows [at, at + remove_count) were replaced with `add_count` rows: move the
+// folds below them, and unfold any they touched.
+void editorFoldsRowsMoved(int at, int remove_count, int add_count);
+// Unfold everything.
+void editorFoldsClear(void);
+// Unfold whatever hides `row`.
+void editorFoldsReveal(int row);
+
+// `row` if it's shown, or else the nearest shown row after it (direction 1)
+// or before it (direction -1).
+int editorFoldsVisibleRow(int row, int direction);
+// the row `count` shown rows after `row`, or before it if `count` is negative
+int editorFoldsStep(int row, int count);
+// how many shown rows are in [from, to)
+int editorFoldsVisibleBetween(int from, int to);
+// After drawing a row that starts a fold, say how many lines are hidden, in at
+// most `available` columns.
+void editorFoldsDrawMarker(struct append_buffer *ab, int filerow,
+                           int available);
+
+#endif
@@ -0,0 +1,301 @@
+#include "buffers.h"
+#include "clipboard.h"
+#include "editor.h"
+#include "undo.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct EditorBuffer {
+  // the buffer's state while inactive; the active buffer's lives in `config`
+  struct EditorConfig state;
+  // set when the rows were dropped to stay within the budget
+  int evicted;
+  // when the buffer was last active, on the `use_clock`
+  uint64_t last_used;
+};
+
+struct EditorBuffers {
+  struct EditorBuffer *buffers;
+  int count;
+  int capacity;
+  int active;
+  size_t budget;
+  uint64_t use_clock;
+};
+
+struct EditorBuffers buffers = {NULL, 0, 0, 0,
+                                (size_t)KILO_MEMORY_BUDGET_MB * 1024 * 1024, 0};
+
+void editorBuffersSetBudget(size_t bytes) { buffers.budget = bytes; }
+
+int editorBufferCount(void) { return buffers.count ? buffers.count : 1; }
+
+int editorBufferActive(void) { return buffers.active; }
+
+#pragma mark - Swapping
+
+// the single document the editor started with becomes the first buffer
+void editorBuffersEnsure(void) {
+  if (buffers.count > 0) {
+    return;
+  }
+  buffers.capacity = 8;
+  buffers.buffers = calloc(buffers.capacity, sizeof(struct EditorBuffer));
+  buffers.count = 1;
+  buffers.active = 0;
+}
+
+// bytes held by a buffer's rows and undo records, from the running counts
+size_t editorBufferMemory(struct EditorConfig *state) {
+  return sizeof(EditorRow) * state->row_capacity + state->row_bytes +
+         state->undo_bytes;
+}
+
+// save the active buffer's state out of `config`
+void editorBufferStash(void) {
+  struct EditorBuffer *buffer = &buffers.buffers[buffers.active];
+  buffer->state = config;
+  buffer->last_used = ++buffers.use_clock;
+}
+
+// Load `state` into `config`, keeping what belongs to the terminal rather than
+// to the document.
+void editorBufferLoad(struct EditorConfig *state) {
+  struct winsize wsize = config.wsize;
+  struct termios original_termios = config.original_termios;
+  int headless = config.headless;
+  char status_message[sizeof(config.status_message)];
+  memcpy(status_message, config.status_message, sizeof(status_message));
+  time_t status_message_time = config.status_message_time;
+
+  config = *state;
+  config.wsize = wsize;
+  config.original_termios = original_termios;
+  config.headless = headless;
+  memcpy(config.status_message, status_message, sizeof(status_message));
+  config.status_message_time = status_message_time;
+}
+
+#pragma mark - Eviction
+
+void editorBufferEvict(struct EditorBuffer *buffer) {
+  for (int j = 0; j < buffer->state.row_count; j++) {
+    editorFreeRow(&buffer->state.rows[j]);
+  }
+  free(buffer->state.rows);
+  buffer->state.rows = NULL;
+  buffer->state.row_count = 0;
+  buffer->state.row_capacity = 0;
+  buffer->state.row_bytes = 0;
+  // reading the rows back in forgets the records anyway
+  editorUndoClearState(&buffer->state);
+
+  editorRowTreeFree(&buffer->state.wrap_index);
+  editorRowTreeFree(&buffer->state.bracket_index);
+  // the rows are read back in from the top, which folds can't follow
+  free(buffer->state.folds);
+  buffer->state.folds = NULL;
+  buffer->state.fold_count = 0;
+  buffer->state.fold_capacity = 0;
+
+  buffer->evicted = 1;
+}
+
+// Drop the rows of the least recently used clean buffers until everything fits
+// in the budget. Buffers with unsaved changes, without a file to reload from,
+// or following a file are never dropped, so the budget is a target rather
+// than a hard limit.
+void editorBuffersEnforceBudget(void) {
+  if (buffers.budget == 0 || buffers.count < 2) {
+    return;
+  }
+
+  // the clipboard can't be dropped, but it takes up part of the budget
+  size_t total = editorBufferMemory(&config) + editorClipboardMemory();
+  for (int j = 0; j < buffers.count; j++) {
+    if (j != buffers.active) {
+      total += editorBufferMemory(&buffers.buffers[j].state);
+    }
+  }
+
+  while (total > buffers.budget) {
+    struct EditorBuffer *victim = NULL;
+    for (int j = 0; j < buffers.count; j++) {
+      struct EditorBuffer *buffer = &buffers.buffers[j];
+      if (j == buffers.active || buffer->evicted || buffer->state.dirty ||
+          buffer->state.filename == NULL || buffer->state.follow_fd != -1) {
+        continue;
+      }
+      if (!victim || buffer->last_used < victim->last_used) {
+        victim = buffer;
+      }
+    }
+    if (!victim) {
+      return;
+    }
+    total -= editorBufferMemory(&victim->state);
+    editorBufferEvict(victim);
+  }
+}
+
+// Read an evicted buffer's rows back in, leaving the view where it was. On
+// error, returns -1 with errno set and the buffer's rows left empty.
+int editorBufferRestoreRows(void) {
+  int cx = config.cx, cy = config.cy;
+  int row_offset = config.row_offset, col_offset = config.col_offset;
+
+  // editorOpenFile replaces the filename it's given
+  char *filename = strdup(config.filename);
+  int result = editorOpenFile(filename);
+  int error = errno;
+  free(filename);
+  if (result == -1) {
+    // whatever was read before the error goes, so the buffer is as it was
+    editorUndoClear();
+    editorFreeRows();
+    config.dirty = 0;
+    errno = error;
+    return -1;
+  }
+
+  config.cy = cy < config.row_count ? cy : config.row_count;
+  int size = config.cy < config.row_count ? config.rows[config.cy].size : 0;
+  config.cx = cx < size ? cx : size;
+  config.row_offset = row_offset;
+  config.col_offset = col_offset;
+  return 0;
+}
+
+#pragma mark - Buffers
+
+void editorBufferSwitch(int index) {
+  editorBuffersEnsure();
+  if (index < 0 || index >= buffers.count || index == buffers.active) {
+    return;
+  }
+
+  int previous = buffers.active;
+  editorBufferStash();
+  buffers.active = index;
+  struct EditorBuffer *buffer = &buffers.buffers[index];
+  editorBufferLoad(&buffer->state);
+  if (buffer->evicted && editorBufferRestoreRows() == -1) {
+    // stay evicted, so the next switch tries again, and go back to where we
+    // were rather than show an empty buffer that could be saved over the file
+    int error = errno;
+    editorBufferStash();
+    buffers.active = previous;
+    editorBufferLoad(&buffers.buffers[previous].state);
+    editorSetStatusMessage("Could not reload %s: %s", buffer->state.filename,
+                           strerror(error));
+    return;
+  }
+  buffer->evicted = 0;
+  editorBuffersEnforceBudget();
+}
+
+int editorBufferOpen(char *filename) {
+  editorBuffersEnsure();
+  for (int j = 0; j < buffers.count; j++) {
+    char *open_filename =
+        j == buffers.active ? config.filename : buffers.buffers[j].state.filename;
+    if (open_filename && strcmp(open_filename, filename) == 0) {
+      editorBufferSwitch(j);
+      return 0;
+    }
+  }
+
+  // a fresh editor with nothing in it can take the file itself
+  int previous = -1;
+  if (config.filename || config.row_count > 0 || config.dirty) {
+    if (buffers.count == buffers.capacity) {
+      buffers.capacity *= 2;
+      buffers.buffers = realloc(buffers.buffers, sizeof(struct EditorBuffer) *
+                                                     buffers.capacity);
+    }
+    previous = buffers.active;
+    editorBufferStash();
+    buffers.active = buffers.count++;
+    memset(&buffers.buffers[buffers.active], 0, sizeof(struct EditorBuffer));
+
+    struct EditorConfig session = config;
+    editorInit();
+    struct EditorConfig fresh = config;
+    config = session;
+    editorBufferLoad(&fresh);
+  }
+
+  if (editorOpenFile(filename) == -1) {
+    // drop what was read and the buffer made for it, and go back
+    int error = errno;
+    editorClose();
+    config.dirty = 0;
+    if (previous != -1) {
+      buffers.count--;
+      buffers.active = previous;
+      editorBufferLoad(&buffers.buffers[previous].state);
+    }
+    errno = error;
+    return -1;
+  }
+  editorBuffersEnforceBudget();
+  return 0;
+}
+
+int editorBuffersModified(void) {
+  int modified = config.dirty ? 1 : 0;
+  for (int j = 0; j < buffers.count; j++) {
+    if (j != buffers.active && buffers.buffers[j].state.dirty) {
+      modified++;
+    }
+  }
+  return modified;
+}
+
+void editorBufferPromptOpen(void) {
+  char *filename = editorPrompt("Open: %s (ESC to cancel)");
+  if (filename == NULL) {
+    return;
+  }
+  // opening is fatal on error at startup, but not from here
+  if (editorBufferOpen(filename) == -1) {
+    editorSetStatusMessage("Could not open %s: %s", filename, strerror(errno));
+  }
+  free(filename);
+}
+
+void editorBufferPromptSwitch(void) {
+  char prompt[64];
+  snprintf(prompt, sizeof(prompt), "Buffer (1-%d or name): %%s",
+           editorBufferCount());
+  char *query = editorPrompt(prompt);
+  if (query == NULL) {
+    return;
+  }
+
+  char *end;
+  long number = strtol(query, &end, 10);
+  int index = -1;
+  if (*end == '\0' && number >= 1 && number <= editorBufferCount()) {
+    index = (int)number - 1;
+  } else {
+    for (int j = 0; j < buffers.count && index == -1; j++) {
+      char *name = j == buffers.active ? config.filename
+                                       : buffers.buffers[j].state.filename;
+      if (name && strstr(name, query)) {
+        index = j;
+      }
+    }
+  }
+
+  if (index == -1) {
+    editorSetStatusMessage("No buffer matches %s", query);
+  } else {
+    editorBufferSwitch(index);
+  }
+  free(query);
+}
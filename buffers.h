@@ -0,0 +1,50 @@
+#ifndef buffers_h
+#define buffers_h
+
+#include <stddef.h>
+
+// Several open files at once. The active buffer's state lives in `config`, so
+// the rest of the editor only ever sees one document; switching swaps another
+// buffer's state in. Unlike `config`, the buffers are shared by every thread,
+// so only the interactive editor's thread uses them; batch mode refuses the
+// keys that would.
+//
+// Inactive buffers count against a memory budget. When it's exceeded, clean
+// buffers that haven't been used for the longest drop their rows and undo
+// records, and read the rows back from disk (through the line cache, when the
+// file has one) the next time they're activated. Every buffer's rows and undo
+// records count towards the budget, as does the clipboard; each keeps a running
+// total, so checking the budget never walks the rows. Text shared between
+// rows (say, lines both in the document and in the clipboard) is counted once
+// for each, so the totals err on the high side.
+
+// the default budget for the rows of all open buffers, in megabytes
+#define KILO_MEMORY_BUDGET_MB 1024
+
+// Set the memory budget in bytes; 0 means unlimited.
+void editorBuffersSetBudget(size_t bytes);
+
+// Open `filename` in a new buffer and make it active, or switch to the buffer
+// that already has it open. An unnamed, empty active buffer is reused. On
+// error, returns -1 with errno set and the previously active buffer still
+// active.
+int editorBufferOpen(char *filename);
+
+// Make the buffer at `index` (0-based) active. If its rows were dropped and
+// can't be read back in, the previously active buffer stays active and the
+// status message says why.
+void editorBufferSwitch(int index);
+
+// how many buffers are open, and which is active
+int editorBufferCount(void);
+int editorBufferActive(void);
+
+// how many buffers, the active one included, have unsaved changes
+int editorBuffersModified(void);
+
+// Prompt for a file to open.
+void editorBufferPromptOpen(void);
+// Prompt for a buffer to switch to, by number or by part of its name.
+void editorBufferPromptSwitch(void);
+
+#endif
@@ -0,0 +1,203 @@
+#include "clipboard.h"
+#include "editor.h"
+#include "undo.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct EditorClipboard {
+  // the copied text, one row per line; the first and last may be parts of
+  // lines, and the text doesn't end with a newline
+  EditorRow *rows;
+  int count;
+  // bytes held by the rows, counted like the document's `row_bytes`
+  size_t bytes;
+};
+
+// like `config`, each thread has its own
+_Thread_local struct EditorClipboard clipboard = {NULL, 0, 0};
+
+#pragma mark - Selection
+
+void editorSelectionToggleMark(void) {
+  config.mark_set = !config.mark_set;
+  config.mark_x = config.cx;
+  config.mark_y = config.cy;
+  editorSetStatusMessage(config.mark_set ? "Mark set." : "Mark cleared.");
+}
+
+// keep a position inside the document; past the last row means the end of it
+void editorSelectionClamp(int *x, int *y) {
+  if (*y >= config.row_count) {
+    *y = config.row_count - 1;
+    *x = config.rows[*y].size;
+  } else if (*x > config.rows[*y].size) {
+    *x = config.rows[*y].size;
+  }
+}
+
+// The selection runs from (*x0, *y0) up to, but not including, (*x1, *y1).
+// Returns 0 if nothing is selected.
+int editorSelectionBounds(int *x0, int *y0, int *x1, int *y1) {
+  if (!config.mark_set || config.row_count == 0) {
+    return 0;
+  }
+  *x0 = config.mark_x;
+  *y0 = config.mark_y;
+  *x1 = config.cx;
+  *y1 = config.cy;
+  editorSelectionClamp(x0, y0);
+  editorSelectionClamp(x1, y1);
+
+  if (*y0 > *y1 || (*y0 == *y1 && *x0 > *x1)) {
+    int x = *x0, y = *y0;
+    *x0 = *x1;
+    *y0 = *y1;
+    *x1 = x;
+    *y1 = y;
+  }
+  return *y0 != *y1 || *x0 != *x1;
+}
+
+int editorSelectionColumns(int filerow, int *from, int *to) {
+  int x0, y0, x1, y1;
+  if (!editorSelectionBounds(&x0, &y0, &x1, &y1) || filerow < y0 ||
+      filerow > y1) {
+    return 0;
+  }
+  EditorRow *row = &config.rows[filerow];
+  *from = filerow == y0 ? editorRowCxToRx(row, x0) : 0;
+  *to = filerow == y1 ? editorRowCxToRx(row, x1) : row->render_size;
+  return *from < *to;
+}
+
+#pragma mark - Clipboard
+
+// init `row` with the concatenation of up to three strings
+void editorClipboardJoinRow(EditorRow *row, char *a, int a_length, char *b,
+                            int b_length, char *c, int c_length) {
+  char *text = malloc(a_length + b_length + c_length + 1);
+  memcpy(text, a, a_length);
+  memcpy(&text[a_length], b, b_length);
+  memcpy(&text[a_length + b_length], c, c_length);
+  editorInitRow(row, text, a_length + b_length + c_length);
+  free(text);
+}
+
+// take chars [from, to) of `row` into `part`, sharing it if it's the whole row
+void editorClipboardTake(EditorRow *row, int from, int to, EditorRow *part) {
+  if (from == 0 && to == row->size) {
+    editorRowShare(row, part);
+  } else {
+    editorInitRow(part, &row->chars[from], to - from);
+  }
+}
+
+void editorClipboardClear(void) {
+  for (int j = 0; j < clipboard.count; j++) {
+    editorFreeRow(&clipboard.rows[j]);
+  }
+  free(clipboard.rows);
+  clipboard.rows = NULL;
+  clipboard.count = 0;
+  clipboard.bytes = 0;
+}
+
+size_t editorClipboardMemory(void) { return clipboard.bytes; }
+
+void editorClipboardYank(int x0, int y0, int x1, int y1) {
+  editorClipboardClear();
+  clipboard.count = y1 - y0 + 1;
+  clipboard.rows = malloc(sizeof(EditorRow) * clipboard.count);
+  for (int y = y0; y <= y1; y++) {
+    EditorRow *row = &config.rows[y];
+    editorClipboardTake(row, y == y0 ? x0 : 0, y == y1 ? x1 : row->size,
+                        &clipboard.rows[y - y0]);
+    clipboard.bytes += editorRowBytes(&clipboard.rows[y - y0]);
+  }
+}
+
+void editorClipboardCopy(void) {
+  int x0, y0, x1, y1;
+  if (!editorSelectionBounds(&x0, &y0, &x1, &y1)) {
+    editorSetStatusMessage("Nothing selected; Ctrl-Space sets the mark.");
+    return;
+  }
+  editorClipboardYank(x0, y0, x1, y1);
+  config.mark_set = 0;
+  editorSetStatusMessage("Copied %d line%s.", clipboard.count,
+                         clipboard.count == 1 ? "" : "s");
+}
+
+void editorClipboardCut(void) {
+  int x0, y0, x1, y1;
+  if (!editorSelectionBounds(&x0, &y0, &x1, &y1)) {
+    editorSetStatusMessage("Nothing selected; Ctrl-Space sets the mark.");
+    return;
+  }
+  editorClipboardYank(x0, y0, x1, y1);
+
+  // what's left of the first and last lines joins up
+  EditorRow *first = &config.rows[y0];
+  EditorRow *last = &config.rows[y1];
+  EditorRow joined;
+  editorClipboardJoinRow(&joined, first->chars, x0, &last->chars[x1],
+                         last->size - x1, "", 0);
+
+  // the cut rows move to the undo record; whole ones are still shared with
+  // the clipboard
+  int count = y1 - y0 + 1;
+  EditorRow *removed = malloc(sizeof(EditorRow) * count);
+  memcpy(removed, first, sizeof(EditorRow) * count);
+  editorUndoRecordRows(y0, count, NULL, 1, removed, count);
+  editorSpliceRows(y0, count, &joined, 1);
+
+  config.cx = x0;
+  config.cy = y0;
+  config.mark_set = 0;
+  editorSetStatusMessage("Cut %d line%s.", count, count == 1 ? "" : "s");
+}
+
+void editorClipboardPaste(void) {
+  if (clipboard.count == 0) {
+    editorSetStatusMessage("Nothing to paste.");
+    return;
+  }
+
+  // the line the cursor is on is split around the pasted text
+  int at = config.cy;
+  int old_count = at < config.row_count ? 1 : 0;
+  char *chars = old_count ? config.rows[at].chars : "";
+  int size = old_count ? config.rows[at].size : 0;
+  int cx = config.cx < size ? config.cx : size;
+
+  int count = clipboard.count;
+  EditorRow *first = &clipboard.rows[0];
+  EditorRow *last = &clipboard.rows[count - 1];
+  EditorRow *rows = malloc(sizeof(EditorRow) * count);
+  if (count == 1) {
+    editorClipboardJoinRow(&rows[0], chars, cx, first->chars, first->size,
+                           &chars[cx], size - cx);
+  } else {
+    editorClipboardJoinRow(&rows[0], chars, cx, first->chars, first->size, "",
+                           0);
+    for (int j = 1; j < count - 1; j++) {
+      editorRowShare(&clipboard.rows[j], &rows[j]);
+    }
+    editorClipboardJoinRow(&rows[count - 1], last->chars, last->size,
+                           &chars[cx], size - cx, "", 0);
+  }
+
+  EditorRow *removed = NULL;
+  if (old_count) {
+    removed = malloc(sizeof(EditorRow));
+    *removed = config.rows[at];
+  }
+  editorUndoRecordRows(at, old_count, NULL, count, removed, old_count);
+  editorSpliceRows(at, old_count, rows, count);
+  free(rows);
+
+  config.cy = at + count - 1;
+  config.cx = count == 1 ? cx + first->size : last->size;
+  config.mark_set = 0;
+}
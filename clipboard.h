@@ -0,0 +1,30 @@
+#ifndef clipboard_h
+#define clipboard_h
+
+#include <stddef.h>
+
+// Selecting text and moving it through the clipboard. The selection runs
+// from the mark (set with Ctrl-Space) to the cursor.
+//
+// The clipboard holds rows, not a string: whole lines in the middle of a
+// selection share their text with the document, so yanking or pasting a huge
+// region copies only the partial lines at either end.
+
+// Set the mark at the cursor, or clear it if it's set.
+void editorSelectionToggleMark(void);
+
+// The render columns [*from, *to) of row `filerow` that are selected. Returns
+// 0 if none of the row is.
+int editorSelectionColumns(int filerow, int *from, int *to);
+
+void editorClipboardCopy(void);
+// Copy the selection, then delete it.
+void editorClipboardCut(void);
+// Insert the clipboard at the cursor, leaving the cursor after it.
+void editorClipboardPaste(void);
+// Empty the calling thread's clipboard.
+void editorClipboardClear(void);
+// bytes held by the clipboard's rows, shared or not
+size_t editorClipboardMemory(void);
+
+#endif
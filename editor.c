@@ -1,6 +1,18 @@
 #include "editor.h"
+#include "brackets.h"
+#include "buffers.h"
+#include "clipboard.h"
 #include "editor-key.h"
+#include "follow.h"
+#include "lines.h"
+#include "line-cache.h"
+#include "perf.h"
+#include "reload.h"
+#include "save.h"
+#include "trace.h"
+#include "undo.h"
 #include "util.h"
+#include "wrap.h"
 
 #include <ctype.h>
 #include <errno.h>
@@ -15,7 +27,7 @@
 #define KILO_QUIT_TIMES 3
 #define CTRL_KEY(k) ((k)&0x1f)
 
-struct EditorConfig config;
+_Thread_local struct EditorConfig config;
 
 void editorInit(void) {
   config.cx = 0;
@@ -24,17 +36,49 @@ void editorInit(void) {
   config.row_offset = 0;
   config.col_offset = 0;
   config.row_count = 0;
+  config.row_capacity = 0;
   config.rows = NULL;
+  config.row_bytes = 0;
   config.dirty = 0;
+  config.read_only = 0;
+  config.headless = 0;
   config.filename = NULL;
+  config.file_version = 0;
+
+  config.wrap = 0;
+  config.wrap_offset = 0;
+  editorWrapInit();
+  config.wrap_cols = 0;
+
+  editorBracketsInit();
+  config.folds = NULL;
+  config.fold_count = 0;
+  config.fold_capacity = 0;
+
+  config.mark_set = 0;
+  config.mark_x = 0;
+  config.mark_y = 0;
+
+  config.undo_records = NULL;
+  config.undo_count = 0;
+  config.undo_capacity = 0;
+  config.undo_bytes = 0;
+
+  config.follow_fd = -1;
+  config.follow_watch_fd = -1;
+  config.follow_offset = 0;
+  config.follow_partial = 0;
 
   config.status_message[0] = '\0';
   config.status_message_time = 0;
+}
 
+void editorInitWindowSize(void) {
   if (editorGetWindowSize(&config.wsize) == -1) {
     die("could not get editor window size.");
   }
 
+  // leave room for the status and message bars
   config.wsize.ws_row -= 2;
 }
 
@@ -47,6 +91,9 @@ void editorSetStatusMessage(const char *fmt, ...) {
 }
 
 void editorUpdateRow(EditorRow *row) {
+  editorPerfCount(PERF_ROW_RENDERS);
+  editorRowUnshare(row);
+
   int tabs = 0;
   for (int j = 0; j < row->size; j++) {
     if (row->chars[j] == '\t')
@@ -70,7 +117,36 @@ void editorUpdateRow(EditorRow *row) {
     }
   }
   row->render[idx] = '\0';
+  editorRowBytesChanged(row, idx - row->render_size);
   row->render_size = idx;
+  // the text no longer matches the file (if it was read from there at all)
+  row->file_offset = -1;
+
+  editorWrapRowUpdated(row);
+  editorBracketsRowUpdated(row);
+}
+
+void editorReserveRows(int capacity) {
+  if (capacity > config.row_capacity) {
+    editorPerfCount(PERF_REALLOCS);
+    config.row_capacity = capacity;
+    config.rows =
+        realloc(config.rows, sizeof(EditorRow) * config.row_capacity);
+  }
+}
+
+void editorInitRow(EditorRow *row, char *s, size_t length) {
+  row->size = (int)length;
+  row->chars = malloc(length + 1);
+  memcpy(row->chars, s, length);
+  row->chars[length] = '\0';
+
+  row->render_size = 0;
+  row->render = NULL;
+  row->wrap_count = 1;
+  row->share = NULL;
+
+  editorUpdateRow(row);
 }
 
 void editorInsertRow(int at, char *s, size_t length) {
@@ -78,39 +154,138 @@ void editorInsertRow(int at, char *s, size_t length) {
     return;
   }
 
-  config.rows =
-      realloc(config.rows, sizeof(EditorRow) * (config.row_count + 1));
-  memmove(&config.rows[at + 1], &config.rows[at],
-          sizeof(EditorRow) * (config.row_count - at));
+  // the row is made before it joins the document, so the indexes over the
+  // rows only hear about it once, as an insertion
+  EditorRow row;
+  editorInitRow(&row, s, length);
+  editorSpliceRows(at, 0, &row, 1);
+}
+
+// replace rows [at, at + remove_count) with `add_count` rows moved out of
+// `rows`. the removed rows are not freed; they belong to the caller.
+void editorSpliceRows(int at, int remove_count, EditorRow *rows,
+                      int add_count) {
+  int row_count = config.row_count - remove_count + add_count;
+  editorFoldsRowsMoved(at, remove_count, add_count);
+  for (int j = 0; j < remove_count; j++) {
+    config.row_bytes -= editorRowBytes(&config.rows[at + j]);
+  }
+  for (int j = 0; j < add_count; j++) {
+    config.row_bytes += editorRowBytes(&rows[j]);
+  }
+  // grow geometrically so appending n rows costs O(n), not O(n^2)
+  if (row_count > config.row_capacity) {
+    int capacity = config.row_capacity ? config.row_capacity : 16;
+    while (capacity < row_count) {
+      capacity *= 2;
+    }
+    editorReserveRows(capacity);
+  }
 
-  config.rows[at].size = (int)length;
-  config.rows[at].chars = malloc(length + 1);
-  memcpy(config.rows[at].chars, s, length);
-  config.rows[at].chars[length] = '\0';
+  memmove(&config.rows[at + add_count], &config.rows[at + remove_count],
+          sizeof(EditorRow) * (config.row_count - at - remove_count));
+  if (add_count > 0) {
+    memcpy(&config.rows[at], rows, sizeof(EditorRow) * add_count);
+  }
+  config.row_count = row_count;
+  config.dirty = 1;
+  editorWrapRowsSpliced(at, remove_count, add_count);
+  editorBracketsRowsSpliced(at, remove_count, add_count);
+}
 
-  config.rows[at].render_size = 0;
-  config.rows[at].render = NULL;
+size_t editorRowBytes(EditorRow *row) {
+  return (size_t)row->size + row->render_size + 2;
+}
 
-  editorUpdateRow(&config.rows[at]);
+void editorRowBytesChanged(EditorRow *row, long long bytes) {
+  if (row >= config.rows && row < config.rows + config.row_count) {
+    config.row_bytes += bytes;
+  }
+}
 
-  config.dirty = 1;
-  config.row_count++;
+// let go of a share, freeing it (and its buffer) if this was the last row
+void editorRowShareRelease(struct RowShare *share) {
+  if (--share->count == 0) {
+    free(share->buffer);
+    free(share);
+  }
 }
 
 void editorFreeRow(EditorRow *row) {
+  struct RowShare *share = row->share;
+  if (share) {
+    // the text is the buffer's, or still the other rows'
+    if (share->buffer || share->count > 1) {
+      editorRowShareRelease(share);
+      return;
+    }
+    free(share);
+  }
   free(row->render);
   free(row->chars);
 }
 
+void editorRowShare(EditorRow *row, EditorRow *copy) {
+  if (row->share == NULL) {
+    row->share = malloc(sizeof(struct RowShare));
+    row->share->count = 1;
+    row->share->buffer = NULL;
+  }
+  row->share->count++;
+  *copy = *row;
+}
+
+void editorRowUnshare(EditorRow *row) {
+  struct RowShare *share = row->share;
+  if (share == NULL) {
+    return;
+  }
+  row->share = NULL;
+  if (share->buffer == NULL && share->count == 1) {
+    // everyone else let go
+    free(share);
+    return;
+  }
+
+  // only the text is copied; the render still belongs to the other rows (or
+  // is the text itself), and editorUpdateRow makes a new one after the row is
+  // modified
+  char *chars = malloc(row->size + 1);
+  memcpy(chars, row->chars, row->size + 1);
+  row->chars = chars;
+  row->render = NULL;
+  editorRowBytesChanged(row, -row->render_size);
+  row->render_size = 0;
+  editorRowShareRelease(share);
+}
+
+void editorFreeRows(void) {
+  editorRowTreeFree(&config.wrap_index);
+  editorRowTreeFree(&config.bracket_index);
+  editorFoldsClear();
+  for (int j = 0; j < config.row_count; j++) {
+    editorFreeRow(&config.rows[j]);
+  }
+  free(config.rows);
+  config.rows = NULL;
+  config.row_count = 0;
+  config.row_capacity = 0;
+  config.row_bytes = 0;
+}
+
 void editorDeleteRow(int at) {
   if (at < 0 || at >= config.row_count) {
     return;
   }
+  editorFoldsRowsMoved(at, 1, 0);
+  config.row_bytes -= editorRowBytes(&config.rows[at]);
   editorFreeRow(&config.rows[at]);
   memmove(&config.rows[at], &config.rows[at + 1],
           sizeof(EditorRow) * (config.row_count - at - 1));
   config.row_count--;
   config.dirty = 1;
+  editorWrapRowsSpliced(at, 1, 0);
+  editorBracketsRowsSpliced(at, 1, 0);
 }
 
 void editorRowInsertChar(EditorRow *row, int at, int c) {
@@ -119,20 +294,26 @@ void editorRowInsertChar(EditorRow *row, int at, int c) {
     at = row->size;
   }
 
+  editorRowUnshare(row);
   // realloc, (2 is for the new byte and null byte)
+  editorPerfCount(PERF_REALLOCS);
   row->chars = realloc(row->chars, row->size + 2);
   // dst, src, length; copy {size+1} bytes from {at} to {at + 1}
   memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
   row->size++;
+  editorRowBytesChanged(row, 1);
   row->chars[at] = c;
   editorUpdateRow(row);
   config.dirty = 1;
 }
 
 void editorRowAppendString(EditorRow *row, char *s, size_t length) {
+  editorRowUnshare(row);
+  editorPerfCount(PERF_REALLOCS);
   row->chars = realloc(row->chars, row->size + length + 1);
   memcpy(&row->chars[row->size], s, length);
   row->size += length;
+  editorRowBytesChanged(row, length);
   row->chars[row->size] = '\0';
   editorUpdateRow(row);
   config.dirty = 0;
@@ -143,8 +324,10 @@ void editorRowDeleteChar(EditorRow *row, int at) {
     return;
   }
 
+  editorRowUnshare(row);
   memmove(&row->chars[at], &row->chars[at + 1], row->size - at);
   row->size--;
+  editorRowBytesChanged(row, -1);
   editorUpdateRow(row);
   config.dirty = 1;
 }
@@ -152,21 +335,28 @@ void editorRowDeleteChar(EditorRow *row, int at) {
 void editorInsertChar(int c) {
   // insert a particular character at the current { x, y }
   if (config.cy == config.row_count) {
+    editorUndoRecordEdit(config.cy, 0, 1);
     editorInsertRow(config.row_count, "", 0);
+  } else {
+    editorUndoRecordEdit(config.cy, 1, 1);
   }
   editorRowInsertChar(&config.rows[config.cy], config.cx, c);
   config.cx++;
 }
 
-void editorInsertNewline() {
+void editorInsertNewline(void) {
   if (config.cx == 0) {
+    editorUndoRecordEdit(config.cy, 0, 1);
     editorInsertRow(config.cy, "", 0);
   } else {
+    editorUndoRecordEdit(config.cy, 1, 2);
     EditorRow *row = &config.rows[config.cy];
     // insert a new row, using the bits to the right of the cursor
     editorInsertRow(config.cy + 1, &row->chars[config.cx],
                     row->size - config.cx);
     row = &config.rows[config.cy];
+    editorRowUnshare(row);
+    editorRowBytesChanged(row, config.cx - row->size);
     row->size = config.cx;
     row->chars[row->size] = '\0';
     editorUpdateRow(row);
@@ -186,9 +376,11 @@ void editorDeleteChar(void) {
   }
   EditorRow *row = &config.rows[config.cy];
   if (config.cx > 0) {
+    editorUndoRecordEdit(config.cy, 1, 1);
     editorRowDeleteChar(row, config.cx - 1);
     config.cx--;
   } else {
+    editorUndoRecordEdit(config.cy - 1, 2, 1);
     // set the cursor position
     config.cx = config.rows[config.cy - 1].size;
     // append the contents of the current row to the previous row
@@ -199,88 +391,108 @@ void editorDeleteChar(void) {
   }
 }
 
-char *editorRowsToString(int *buffer_length) {
-  int total_length = 0;
-
-  // calculate length of current buffer
-  for (int j = 0; j < config.row_count; j++) {
-    // include a byte for a newline character at the end of each line
-    total_length += config.rows[j].size + 1;
-  }
-
-  *buffer_length = total_length;
-
-  // allocate a new buffer and copy the contents into it
-  char *buf = malloc(total_length);
-  char *p = buf;
-  for (int j = 0; j < config.row_count; j++) {
-    memcpy(p, config.rows[j].chars, config.rows[j].size);
-    p += config.rows[j].size;
-    // append the newline we allocated size for
-    *p = '\n';
-    p++;
-  }
-
-  return buf;
-}
-
-void editorOpen(char *filename) {
+int editorOpenFile(char *filename) {
+  editorUndoClear();
   free(config.filename);
   config.filename = strdup(filename);
+  editorSaveBeginVersion();
+
+  // an unchanged file we've seen before doesn't need to be scanned for lines
+  if (editorLineCacheLoad(filename)) {
+    config.dirty = 0;
+    editorRecordFileStamp();
+    return 0;
+  }
 
   FILE *fp = fopen(filename, "r");
   if (!fp) {
-    die("could not open file.");
+    return -1;
   }
 
   char *line = NULL;
   size_t linecap = 0;
   ssize_t line_length;
+  off_t offset = 0;
+  struct LineIndex index = line_index_init;
 
   while ((line_length = getline(&line, &linecap, fp)) != -1) {
+    ssize_t raw_length = line_length;
     while (line_length > 0 &&
            (line[line_length - 1] == '\n' || line[line_length - 1] == '\r')) {
       line_length--;
     }
     editorInsertRow(config.row_count, line, line_length);
+    editorSaveRowRead(&config.rows[config.row_count - 1], offset,
+                      raw_length == line_length + 1 &&
+                          line[line_length] == '\n');
+    editorLineIndexAppend(&index, (uint32_t)line_length,
+                          (uint8_t)(raw_length - line_length));
+    offset += raw_length;
   }
 
+  // e.g. a directory, which opens but can't be read
+  int error = ferror(fp) ? errno : 0;
   free(line);
   fclose(fp);
+  if (error) {
+    editorLineIndexFree(&index);
+    errno = error;
+    return -1;
+  }
   config.dirty = 0;
+  editorRecordFileStamp();
+
+  editorLineCacheStore(filename, &index);
+  editorLineIndexFree(&index);
+  return 0;
 }
 
-void editorSave() {
+void editorOpen(char *filename) {
+  if (editorOpenFile(filename) == -1) {
+    die("could not open file.");
+  }
+}
+
+void editorClose(void) {
+  editorUndoClear();
+  editorFreeRows();
+  free(config.filename);
+  config.filename = NULL;
+  editorRowTreeFree(&config.wrap_index);
+  editorRowTreeFree(&config.bracket_index);
+}
+
+int editorSave(void) {
   if (config.filename == NULL) {
     config.filename = editorPrompt("Save as: %s");
     if (config.filename == NULL) {
       editorSetStatusMessage("Save aborted.");
-      return;
+      return -1;
     }
   }
 
-  int length;
-  char *buffer = editorRowsToString(&length);
-
-  //  0644 -> owner has read/write, others can read
-  int file_descriptor = open(config.filename, O_RDWR | O_CREAT, 0644);
-
-  if (file_descriptor != -1) {
-    if (ftruncate(file_descriptor, length) != -1) {
-      if (write(file_descriptor, buffer, length) == length) {
-        close(file_descriptor);
-        free(buffer);
-        editorSetStatusMessage("Saved %d bytes to %s successfully.", length,
-                               config.filename);
-        config.dirty = 0;
-        return;
-      }
-    }
-    close(file_descriptor);
+  long long copied;
+  int mode_error;
+  long long length = editorSaveWrite(&copied, &mode_error);
+  if (length == -1) {
+    editorSetStatusMessage("Could not save file! I/O error: %s",
+                           strerror(errno));
+    return -1;
   }
-
-  free(buffer);
-  editorSetStatusMessage("Could not save file! I/O error: %s", strerror(errno));
+  if (mode_error) {
+    editorSetStatusMessage("Saved %s, but could not keep its permissions: %s",
+                           config.filename, strerror(mode_error));
+  } else if (copied > 0) {
+    editorSetStatusMessage("Saved %lld bytes (%lld copied) to %s successfully.",
+                           length, copied, config.filename);
+  } else {
+    editorSetStatusMessage("Saved %lld bytes to %s successfully.", length,
+                           config.filename);
+  }
+  config.dirty = 0;
+  editorRecordFileStamp();
+  editorLineCacheStoreRows();
+  return 0;
 }
 
 /*
@@ -289,26 +501,49 @@ void editorSave() {
  seems like the reader will have trouble following what it means or why.
  */
 
+int editorDecodeKey(char c);
+
 int editorReadKey(void) {
   int nread;
   char c;
 
-  while ((nread = (int)read(STDIN_FILENO, &c, 1)) != 1) {
+  while ((nread = editorTraceReadByte(&c)) != 1) {
     if (nread == -1 && errno != EAGAIN) {
       die("could not read from STDIN.");
     }
+    // a replayed trace has ended; unwind any prompt that's waiting for input
+    if (editorTraceExhausted()) {
+      return '\x1b';
+    }
+    // while following a file, sleep until a keypress or new data arrives
+    if (config.follow_fd != -1 && editorFollowWait()) {
+      editorRefreshScreen();
+    }
+    // otherwise, use the idle time to notice changes made by others
+    if (nread == 0 && editorCheckFileChange()) {
+      editorRefreshScreen();
+    }
   }
 
+  // time the decoding, not the wait for the user
+  uint64_t start = editorPerfNow();
+  int key = editorDecodeKey(c);
+  editorPerfRecord(PERF_INPUT, start);
+  return key;
+}
+
+// turn a byte, and any escape sequence it starts, into a key
+int editorDecodeKey(char c) {
   if (c == '\x1b') {
     char seq[3];
-    if (read(STDIN_FILENO, &seq[0], 1) != 1 ||
-        read(STDIN_FILENO, &seq[1], 1) != 1) {
+    if (editorTraceReadByte(&seq[0]) != 1 ||
+        editorTraceReadByte(&seq[1]) != 1) {
       return '\x1b';
     }
 
     if (seq[0] == '[') {
       if (seq[1] >= '0' && seq[1] <= '9') {
-        if (read(STDIN_FILENO, &seq[2], 1) != 1) {
+        if (editorTraceReadByte(&seq[2]) != 1) {
           return '\x1b';
         }
         if (seq[2] == '~') {
@@ -361,10 +596,14 @@ int editorReadKey(void) {
 }
 
 void editorDrawRows(struct append_buffer *ab) {
-  for (int y = 0; y < config.wsize.ws_row; y++) {
-    int filerow = y + config.row_offset;
+  if (config.wrap) {
+    editorWrapDrawRows(ab);
+    return;
+  }
 
-    if (y >= config.row_count) {
+  int filerow = config.row_offset;
+  for (int y = 0; y < config.wsize.ws_row; y++) {
+    if (filerow >= config.row_count) {
       // print welcome message 1/3 of the way down the page
       if (config.row_count == 0 && y == config.wsize.ws_row / 3) {
         char welcome[80];
@@ -395,24 +634,55 @@ void editorDrawRows(struct append_buffer *ab) {
       if (length > config.wsize.ws_col) {
         length = config.wsize.ws_col;
       }
-      append_buffer_append(ab, &config.rows[filerow].render[config.col_offset],
-                           length);
+      editorDrawRowSegment(ab, filerow, config.col_offset, length);
+      editorFoldsDrawMarker(ab, filerow, config.wsize.ws_col - length);
     }
 
     // 'ERASE IN LINE': clear each line as we redraw it
     append_buffer_append(ab, "\x1b[K", 3);
     append_buffer_append(ab, "\r\n", 2);
+    filerow = editorFoldsVisibleRow(filerow + 1, 1);
+  }
+}
+
+void editorDrawRowSegment(struct append_buffer *ab, int filerow, int start,
+                          int length) {
+  EditorRow *row = &config.rows[filerow];
+  if (length <= 0) {
+    return;
+  }
+
+  int from, to;
+  if (!editorSelectionColumns(filerow, &from, &to) || to <= start ||
+      from >= start + length) {
+    append_buffer_append(ab, &row->render[start], length);
+    return;
   }
+
+  from = from > start ? from : start;
+  to = to < start + length ? to : start + length;
+  append_buffer_append(ab, &row->render[start], from - start);
+  append_buffer_append(ab, "\x1b[7m", 4);
+  append_buffer_append(ab, &row->render[from], to - from);
+  append_buffer_append(ab, "\x1b[m", 3);
+  append_buffer_append(ab, &row->render[to], start + length - to);
 }
 
 void editorDrawStatusBar(struct append_buffer *ab) {
   // m -> select graphic rendition
   append_buffer_append(ab, "\x1b[7m", 4);
 
-  char status[80], rstatus[80];
-  int len = snprintf(status, sizeof(status), "%.20s - %d lines %s",
+  char status[80], rstatus[80], position[24] = "";
+  if (editorBufferCount() > 1) {
+    snprintf(position, sizeof(position), "[%d/%d] ", editorBufferActive() + 1,
+             editorBufferCount());
+  }
+  int len = snprintf(status, sizeof(status), "%s%.20s - %d lines %s", position,
                      config.filename ? config.filename : "[No Name]",
-                     config.row_count, config.dirty ? "(modified)" : "");
+                     config.row_count,
+                     config.dirty             ? "(modified)"
+                     : config.follow_fd != -1 ? "(following)"
+                                              : "");
   int rlen = snprintf(rstatus, sizeof(rstatus), "%d/%d", config.cy + 1,
                       config.row_count);
 
@@ -457,17 +727,41 @@ int editorRowCxToRx(EditorRow *row, int cx) {
   return rx;
 }
 
+int editorRowRxToCx(EditorRow *row, int rx) {
+  int current_rx = 0;
+  int cx;
+  for (cx = 0; cx < row->size; cx++) {
+    if (row->chars[cx] == '\t') {
+      current_rx += (KILO_TAB_STOP - 1) - (current_rx % KILO_TAB_STOP);
+    }
+    current_rx++;
+    if (current_rx > rx) {
+      return cx;
+    }
+  }
+  return cx;
+}
+
 void editorScroll(void) {
+  if (config.wrap) {
+    editorWrapScroll();
+    return;
+  }
+
   config.rx = 0;
   if (config.cy < config.row_count) {
     config.rx = editorRowCxToRx(&config.rows[config.cy], config.cx);
   }
 
+  // a jump or an edit may have put the cursor inside a fold
+  editorFoldsReveal(config.cy);
+  config.row_offset = editorFoldsVisibleRow(config.row_offset, -1);
   if (config.cy < config.row_offset) {
     config.row_offset = config.cy;
   }
-  if (config.cy >= config.row_offset + config.wsize.ws_row) {
-    config.row_offset = config.cy - config.wsize.ws_row + 1;
+  if (editorFoldsVisibleBetween(config.row_offset, config.cy) >=
+      config.wsize.ws_row) {
+    config.row_offset = editorFoldsStep(config.cy, -(config.wsize.ws_row - 1));
   }
   if (config.rx < config.col_offset) {
     config.col_offset = config.rx;
@@ -482,27 +776,49 @@ void append_terminal_command_to_buffer(struct append_buffer *ab,
   append_buffer_append(ab, tc.string_representation, tc.length);
 }
 
-void editorRefreshScreen(void) {
+void editorRenderScreen(struct append_buffer *ab) {
+  uint64_t start = editorPerfNow();
   editorScroll();
-
-  struct append_buffer ab = append_buffer_init;
-
-  append_terminal_command_to_buffer(&ab, moveCursorToTopLeft());
-  append_terminal_command_to_buffer(&ab, hideCursor());
-
-  editorDrawRows(&ab);
-  editorDrawStatusBar(&ab);
-  editorDrawMessageBar(&ab);
+  editorPerfRecord(PERF_SCROLL, start);
+
+  append_terminal_command_to_buffer(ab, moveCursorToTopLeft());
+  append_terminal_command_to_buffer(ab, hideCursor());
+
+  start = editorPerfNow();
+  editorDrawRows(ab);
+  editorPerfRecord(PERF_DRAW_ROWS, start);
+  editorDrawStatusBar(ab);
+  editorDrawMessageBar(ab);
+  editorPerfDrawOverlay(ab, config.wsize.ws_row, config.wsize.ws_col);
+
+  int cursor_y = editorFoldsVisibleBetween(config.row_offset, config.cy);
+  int cursor_x = config.rx - config.col_offset;
+  if (config.wrap) {
+    editorWrapCursorPosition(&cursor_y, &cursor_x);
+    cursor_y -= config.wrap_offset;
+  }
 
   char buf[32];
-  snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (config.cy - config.row_offset) + 1,
-           (config.rx - config.col_offset) + 1);
-  append_buffer_append(&ab, buf, (int)strlen(buf));
+  snprintf(buf, sizeof(buf), "\x1b[%d;%dH", cursor_y + 1, cursor_x + 1);
+  append_buffer_append(ab, buf, (int)strlen(buf));
 
-  append_terminal_command_to_buffer(&ab, displayCursor());
+  append_terminal_command_to_buffer(ab, displayCursor());
+}
+
+int editorRefreshScreen(void) {
+  struct append_buffer ab = append_buffer_init;
+  editorRenderScreen(&ab);
 
-  write(STDOUT_FILENO, ab.b, ab.length);
+  if (!config.headless) {
+    uint64_t start = editorPerfNow();
+    write(STDOUT_FILENO, ab.b, ab.length);
+    editorPerfRecord(PERF_WRITE, start);
+  }
+  editorPerfAdd(PERF_FRAME_BYTES, ab.length);
+  editorPerfCount(PERF_FRAMES);
+  int length = ab.length;
   append_buffer_free(&ab);
+  return length;
 }
 
 int editorGetWindowSize(struct winsize *wsize) {
@@ -523,32 +839,129 @@ int editorGetWindowSize(struct winsize *wsize) {
   return 0;
 }
 
-void editorProcessKeypress(void) {
-  static int quit_times = KILO_QUIT_TIMES;
+// returns 0 (and tells the user why) if the document may not be modified.
+int editorCheckWritable(void) {
+  if (config.read_only) {
+    editorSetStatusMessage("%s is read-only.",
+                           config.filename ? config.filename : "Buffer");
+    return 0;
+  }
+  return 1;
+}
+
+int editorProcessKeypress(void) {
   int c = editorReadKey();
 
+  uint64_t start = editorPerfNow();
+  int running = editorHandleKeypress(c);
+  editorPerfRecord(PERF_KEYPRESS, start);
+  return running;
+}
+
+int editorHandleKeypress(int c) {
+  static _Thread_local int quit_times = KILO_QUIT_TIMES;
+  static _Thread_local int overwrite_confirmed = 0;
+
   switch (c) {
   case '\r':
-    editorInsertNewline();
+    if (editorCheckWritable()) {
+      editorInsertNewline();
+    }
     break;
 
   case CTRL_KEY('q'):
-    if (config.dirty && quit_times > 0) {
-      editorSetStatusMessage("WARNING! File has unsaved changes. Press Ctrl-Q "
-                             "%d more time%s to quit.",
-                             quit_times, quit_times == 1 ? "" : "s");
+    if (editorBuffersModified() && quit_times > 0) {
+      if (config.dirty) {
+        editorSetStatusMessage("WARNING! File has unsaved changes. Press "
+                               "Ctrl-Q %d more time%s to quit.",
+                               quit_times, quit_times == 1 ? "" : "s");
+      } else {
+        editorSetStatusMessage("WARNING! %d buffer%s unsaved. Press Ctrl-Q %d "
+                               "more time%s to quit.",
+                               editorBuffersModified(),
+                               editorBuffersModified() == 1 ? " is" : "s are",
+                               quit_times, quit_times == 1 ? "" : "s");
+      }
       quit_times--;
-      return;
+      overwrite_confirmed = 0;
+      return 1;
     }
-    clearDisplayForStandardOut();
-    repositionCursorToTopLeft();
-    exit(0);
-    break;
+    editorLineCacheStoreCursor();
+    return 0;
 
   case CTRL_KEY('s'):
+    if (!editorCheckWritable()) {
+      break;
+    }
+    // don't silently clobber somebody else's changes
+    if (!overwrite_confirmed && editorFileChangedOnDisk()) {
+      editorSetStatusMessage("WARNING! File changed on disk. Ctrl-S again to "
+                             "overwrite, Ctrl-R to reload.");
+      overwrite_confirmed = 1;
+      quit_times = KILO_QUIT_TIMES;
+      return 1;
+    }
     editorSave();
     break;
 
+  case '\0':
+    // Ctrl-Space
+    editorSelectionToggleMark();
+    break;
+
+  case CTRL_KEY('c'):
+    editorClipboardCopy();
+    break;
+
+  case CTRL_KEY('x'):
+    if (editorCheckWritable()) {
+      editorClipboardCut();
+    }
+    break;
+
+  case CTRL_KEY('v'):
+    if (editorCheckWritable()) {
+      editorClipboardPaste();
+    }
+    break;
+
+  case CTRL_KEY('z'):
+    if (editorCheckWritable() && !editorUndo()) {
+      editorSetStatusMessage("Nothing to undo.");
+    }
+    break;
+
+  case CTRL_KEY('e'):
+    if (editorCheckWritable()) {
+      editorLineCommandPrompt();
+    }
+    break;
+
+  case CTRL_KEY('o'):
+    editorBufferPromptOpen();
+    break;
+
+  case CTRL_KEY('b'):
+    editorBufferPromptSwitch();
+    break;
+
+  case CTRL_KEY('r'):
+    if (config.follow_fd != -1 || config.filename == NULL) {
+      break;
+    }
+    {
+      int read_count = editorReloadChanged();
+      if (read_count == -1) {
+        editorSetStatusMessage("Could not reload file! I/O error: %s",
+                               strerror(errno));
+      } else {
+        editorSetStatusMessage("Reloaded %s; read %d changed line%s.",
+                               config.filename, read_count,
+                               read_count == 1 ? "" : "s");
+      }
+    }
+    break;
+
   case HOME_KEY:
     config.cx = 0;
     break;
@@ -562,6 +975,9 @@ void editorProcessKeypress(void) {
   case BACKSPACE:
   case CTRL_KEY('h'):
   case DEL_KEY:
+    if (!editorCheckWritable()) {
+      break;
+    }
     if (c == DEL_KEY) {
       editorMoveCursor(ARROW_RIGHT);
     }
@@ -570,10 +986,14 @@ void editorProcessKeypress(void) {
 
   case PAGE_UP:
   case PAGE_DOWN: {
+    if (config.wrap) {
+      editorWrapPage(c);
+      break;
+    }
     if (c == PAGE_UP) {
       config.cy = config.row_offset;
     } else if (c == PAGE_DOWN) {
-      config.cy = config.row_offset + config.wsize.ws_row - 1;
+      config.cy = editorFoldsStep(config.row_offset, config.wsize.ws_row - 1);
       if (config.cy > config.row_count) {
         config.cy = config.row_count;
       }
@@ -593,19 +1013,48 @@ void editorProcessKeypress(void) {
     editorMoveCursor(c);
     break;
 
-  case CTRL_KEY('l'):
+  case CTRL_KEY('p'):
+    editorPerfToggleOverlay();
+    break;
+
+  case CTRL_KEY(']'):
+    editorBracketsJump();
+    break;
+
+  case CTRL_KEY('f'):
+    editorFoldToggle();
+    break;
+
+  case CTRL_KEY('w'):
+    editorWrapToggle();
+    editorSetStatusMessage("Soft wrap %s.", config.wrap ? "on" : "off");
+    break;
+
   case '\x1b':
+    config.mark_set = 0;
+    break;
+
+  case CTRL_KEY('l'):
     break;
 
   default:
-    editorInsertChar(c);
+    if (editorCheckWritable()) {
+      editorInsertChar(c);
+    }
     break;
   }
 
   quit_times = KILO_QUIT_TIMES;
+  overwrite_confirmed = 0;
+  return 1;
 }
 
 void editorMoveCursor(int keypress) {
+  if (config.wrap && (keypress == ARROW_UP || keypress == ARROW_DOWN)) {
+    editorWrapMoveCursor(keypress);
+    return;
+  }
+
   EditorRow *row =
       (config.cy >= config.row_count) ? NULL : &config.rows[config.cy];
   switch (keypress) {
@@ -613,7 +1062,7 @@ void editorMoveCursor(int keypress) {
     if (config.cx != 0) {
       config.cx--;
     } else if (config.cy > 0) {
-      config.cy--;
+      config.cy = editorFoldsVisibleRow(config.cy - 1, -1);
       config.cx = config.rows[config.cy].size;
     }
     break;
@@ -621,23 +1070,23 @@ void editorMoveCursor(int keypress) {
     if (row && config.cx < row->size) {
       config.cx++;
     } else if (row && config.cx == row->size) {
-      config.cy++;
+      config.cy = editorFoldsVisibleRow(config.cy + 1, 1);
       config.cx = 0;
     }
     break;
   case ARROW_UP:
     if (config.cy > 0) {
-      config.cy--;
+      config.cy = editorFoldsVisibleRow(config.cy - 1, -1);
     }
     break;
   case ARROW_DOWN:
     if (config.cy < config.row_count) {
-      config.cy++;
+      config.cy = editorFoldsVisibleRow(config.cy + 1, 1);
     }
     break;
   }
 
-  row = (config.cy > config.row_count) ? NULL : &config.rows[config.cy];
+  row = (config.cy >= config.row_count) ? NULL : &config.rows[config.cy];
   int row_length = row ? row->size : 0;
   if (config.cx > row_length) {
     config.cx = row_length;
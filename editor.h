@@ -2,7 +2,9 @@
 #define editor_h
 
 #include "append-buffer.h"
+#include "row-tree.h"
 #include <sys/ioctl.h>
+#include <sys/types.h>
 #include <termios.h>
 #include <time.h>
 
@@ -14,8 +16,47 @@ typedef struct EditorRow {
   // the actual rendered string and its size (\t is an impl-specific size)
   int render_size;
   char *render;
+
+  // how many screen lines the row takes up when soft wrapping
+  int wrap_count;
+
+  // the brackets the row leaves unmatched: closing ones, then opening ones;
+  // -1 until they're counted
+  int bracket_closes;
+  int bracket_opens;
+
+  // where the row's text, and the newline after it, is in version
+  // `file_version` of the file; -1 if the row was edited, or never read from it
+  unsigned file_version;
+  off_t file_offset;
+
+  // the text this row holds on to along with other rows (e.g. with the
+  // clipboard), or NULL when it's the row's alone; shared rows are copied
+  // before they're modified
+  struct RowShare *share;
 } EditorRow;
 
+// text held by several rows, freed once the last of them lets go
+struct RowShare {
+  // how many rows hold on to it. Not atomic: rows are only ever shared,
+  // unshared and freed by the thread whose document they belong to, and
+  // parallel workers only read them or build new, unshared rows
+  int count;
+  // when set, each row's text lies in this one buffer (e.g. a whole file read
+  // in at once), NUL-terminated, and `render` is `chars`; otherwise the rows
+  // all have the same `chars` and `render`
+  char *buffer;
+};
+
+// identifies one version of a file on disk
+struct FileStamp {
+  dev_t device;
+  ino_t inode;
+  off_t size;
+  time_t mtime_sec;
+  long mtime_nsec;
+};
+
 struct EditorConfig {
   // current cursor position
   int cx, cy;
@@ -25,30 +66,129 @@ struct EditorConfig {
   struct winsize wsize;
   // number of rows in the current document
   int row_count;
+  // number of rows allocated in `rows`; grows geometrically
+  int row_capacity;
   // current row offset
   int row_offset;
   // current col offset
   int col_offset;
   // the lines in the current file
   EditorRow *rows;
+  // bytes held by the rows' text and renders (see editorRowBytes), kept up to
+  // date as rows change so that it never takes a walk over them
+  size_t row_bytes;
   // indicates whether the file has been modified since opening or saving
   int dirty;
+  // when set, keypresses that would modify the document are rejected
+  int read_only;
+  // when set, frames are rendered but never written to the terminal
+  int headless;
   // file currently being edited.
   char *filename;
+  // the version of `filename` last read or written by us
+  struct FileStamp file_stamp;
+  // which version of `filename` the rows' file offsets refer to
+  unsigned file_version;
+  // set once the user has been told the file changed underneath them
+  int file_change_warned;
   // an optional helpful message to the user
   char status_message[80];
   // the time the status message was displayed
   time_t status_message_time;
   // the terminal settings acquired on program start
   struct termios original_termios;
+
+  // soft wrap: whether long rows continue on the following screen lines
+  int wrap;
+  // soft wrap: the visual line shown at the top of the screen
+  int wrap_offset;
+  // soft wrap: the rows' wrap counts, summed over runs of rows, which finds
+  // where visual line N starts in O(log n) and is patched in O(log n) when
+  // rows change; not built (or kept up to date) while wrapping is off
+  struct RowTree wrap_index;
+  // soft wrap: the width the wrap counts were computed for
+  int wrap_cols;
+
+  // brackets: the rows' unmatched brackets, combined over runs of rows; not
+  // built until a match is first looked for
+  struct RowTree bracket_index;
+  // folding: the runs of hidden rows, in order
+  struct EditorFold *folds;
+  int fold_count;
+  int fold_capacity;
+
+  // selection: whether the mark is set, and where; the selection runs from
+  // the mark to the cursor
+  int mark_set;
+  int mark_x, mark_y;
+
+  // undo: the records of past edits, most recent last
+  struct EditorUndo *undo_records;
+  int undo_count;
+  int undo_capacity;
+  // undo: bytes held by the records' rows, counted like `row_bytes`
+  size_t undo_bytes;
+
+  // follow mode: the file being tailed, or -1 when not following
+  int follow_fd;
+  // follow mode: inotify descriptor watching the file, or -1 if unavailable
+  int follow_watch_fd;
+  // follow mode: how many bytes of the file have been read so far
+  off_t follow_offset;
+  // follow mode: whether the last row is still waiting for its newline
+  int follow_partial;
 };
 
-extern struct EditorConfig config;
+// each thread has its own editor, so batch mode can edit several documents at
+// once; the interactive editor only ever uses the main thread's
+extern _Thread_local struct EditorConfig config;
 
-// Init the global state for the editor.
+// Init the calling thread's editor state. Doesn't touch the terminal.
 void editorInit(void);
-// edit the file at the given path.
+// Size the editor to the terminal; not needed when running headless.
+void editorInitWindowSize(void);
+// edit the file at the given path; exits if it can't be read.
 void editorOpen(char *filename);
+// edit the file at the given path. returns -1 (with errno set) if it can't be
+// read, leaving a partial document to be closed.
+int editorOpenFile(char *filename);
+// release the document and everything derived from it.
+void editorClose(void);
+// write the document back to its file. returns -1 (after saying why in the
+// status message) if it wasn't saved.
+int editorSave(void);
+
+// Row operations on the current document.
+void editorUpdateRow(EditorRow *row);
+// fill in a new row with a copy of `length` bytes of `s`.
+void editorInitRow(EditorRow *row, char *s, size_t length);
+void editorReserveRows(int capacity);
+void editorInsertRow(int at, char *s, size_t length);
+void editorSpliceRows(int at, int remove_count, EditorRow *rows, int add_count);
+void editorFreeRow(EditorRow *row);
+// what `row` counts for in `row_bytes`: its text and render, terminators
+// included. shared text is counted for every row that holds it.
+size_t editorRowBytes(EditorRow *row);
+// `row` grew by `bytes` (or shrank, if negative); counted if it's one of the
+// document's rows.
+void editorRowBytesChanged(EditorRow *row, long long bytes);
+// make `copy` another handle on `row`'s text, without copying it.
+void editorRowShare(EditorRow *row, EditorRow *copy);
+// give `row` its own copy of its text, if it's shared, before modifying it.
+// its render may be dropped, so editorUpdateRow must follow.
+void editorRowUnshare(EditorRow *row);
+// free every row in the document.
+void editorFreeRows(void);
+void editorRowInsertChar(EditorRow *row, int at, int c);
+void editorRowAppendString(EditorRow *row, char *s, size_t length);
+// convert between indexes into `chars` and columns in `render`.
+int editorRowCxToRx(EditorRow *row, int cx);
+int editorRowRxToCx(EditorRow *row, int rx);
+
+// Editing operations at the cursor.
+void editorInsertChar(int c);
+void editorInsertNewline(void);
+void editorDeleteChar(void);
 
 // Read the next character from STDIN.
 int editorReadKey(void);
@@ -58,12 +198,23 @@ int editorGetWindowSize(struct winsize *wsize);
 void editorSetStatusMessage(const char *fmt, ...);
 char *editorPrompt(char *prompt);
 
-// Read the next character from STDIN and process it immediately.
-void editorProcessKeypress(void);
+// Read the next character from STDIN and process it immediately. Returns 0
+// once the user has asked to quit.
+int editorProcessKeypress(void);
+// Act on a single key, as returned by editorReadKey.
+int editorHandleKeypress(int c);
 void editorMoveCursor(int keypress);
 void editorDrawRows(struct append_buffer *ab);
+// draw render columns [start, start + length) of a row, highlighting the part
+// that's selected.
+void editorDrawRowSegment(struct append_buffer *ab, int filerow, int start,
+                          int length);
 void editorScroll(void);
-void editorRefreshScreen(void);
+// Build a complete frame (rows, status bar, message bar and cursor) in `ab`.
+void editorRenderScreen(struct append_buffer *ab);
+// Draw a frame, and write it to the terminal unless headless. Returns its size
+// in bytes.
+int editorRefreshScreen(void);
 int getCursorPosition(struct winsize *wsize);
 
 #endif
@@ -0,0 +1,235 @@
+#include "edits.h"
+#include "brackets.h"
+#include "editor.h"
+#include "parallel.h"
+#include "undo.h"
+#include "wrap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#pragma mark - Applying
+
+struct EditsBatch {
+  EditorRow *rows;
+  struct EditSite *sites;
+  // the rows being edited, and where each one's sites start (with a sentinel
+  // at the end)
+  int *affected;
+  int *first_site;
+  // the rebuilt rows
+  EditorRow *rebuilt;
+};
+
+// rebuild affected rows [begin, end), each in one pass
+void editorEditsRebuild(void *context, int begin, int end) {
+  struct EditsBatch *batch = context;
+  for (int k = begin; k < end; k++) {
+    EditorRow *row = &batch->rows[batch->affected[k]];
+    struct EditSite *site = &batch->sites[batch->first_site[k]];
+    struct EditSite *sites_end = &batch->sites[batch->first_site[k + 1]];
+
+    int size = row->size;
+    for (struct EditSite *s = site; s < sites_end; s++) {
+      size += s->text_length - s->length;
+    }
+
+    char *chars = malloc(size + 1);
+    int from = 0, to = 0;
+    for (struct EditSite *s = site; s < sites_end; s++) {
+      memcpy(&chars[to], &row->chars[from], s->at - from);
+      to += s->at - from;
+      memcpy(&chars[to], s->text, s->text_length);
+      to += s->text_length;
+      from = s->at + s->length;
+    }
+    memcpy(&chars[to], &row->chars[from], row->size - from);
+    chars[size] = '\0';
+
+    EditorRow *rebuilt = &batch->rebuilt[k];
+    rebuilt->size = size;
+    rebuilt->chars = chars;
+    rebuilt->render_size = 0;
+    rebuilt->render = NULL;
+    rebuilt->wrap_count = 1;
+    rebuilt->share = NULL;
+    editorUpdateRow(rebuilt);
+  }
+}
+
+void editorApplyEdits(struct EditSite *sites, int count) {
+  if (count == 0) {
+    return;
+  }
+
+  struct EditsBatch batch;
+  batch.rows = config.rows;
+  batch.sites = sites;
+  batch.affected = malloc(sizeof(int) * count);
+  batch.first_site = malloc(sizeof(int) * (count + 1));
+  int affected_count = 0;
+  for (int j = 0; j < count; j++) {
+    if (j == 0 || sites[j].row != sites[j - 1].row) {
+      batch.affected[affected_count] = sites[j].row;
+      batch.first_site[affected_count] = j;
+      affected_count++;
+    }
+  }
+  batch.first_site[affected_count] = count;
+  batch.rebuilt = malloc(sizeof(EditorRow) * affected_count);
+
+  // rows can be rebuilt independently; they're added to the wrap and bracket
+  // indexes below, since workers don't see `config`
+  editorParallelFor(editorParallelWorkers(affected_count), affected_count,
+                    editorEditsRebuild, &batch);
+
+  // swap the rebuilt rows in; the old ones go to the undo record
+  int at = batch.affected[0];
+  int span = batch.affected[affected_count - 1] - at + 1;
+  int *source = malloc(sizeof(int) * span);
+  for (int j = 0; j < span; j++) {
+    source[j] = j;
+  }
+  EditorRow *removed = malloc(sizeof(EditorRow) * affected_count);
+  for (int k = 0; k < affected_count; k++) {
+    int row = batch.affected[k];
+    removed[k] = config.rows[row];
+    config.rows[row] = batch.rebuilt[k];
+    config.row_bytes +=
+        editorRowBytes(&config.rows[row]) - editorRowBytes(&removed[k]);
+    source[row - at] = -1;
+  }
+  editorUndoRecordRows(at, span, source, span, removed, affected_count);
+  for (int k = 0; k < affected_count; k++) {
+    editorWrapRowUpdated(&config.rows[batch.affected[k]]);
+    editorBracketsRowUpdated(&config.rows[batch.affected[k]]);
+  }
+  config.dirty = 1;
+
+  free(batch.affected);
+  free(batch.first_site);
+  free(batch.rebuilt);
+}
+
+#pragma mark - Collecting
+
+struct EditsSearch {
+  EditorRow *rows;
+  int first, last;
+  const char *from;
+  int from_length;
+  const char *to;
+  int to_length;
+  // the sites each worker found in its share of the rows, in order
+  int worker_count;
+  struct EditSite *sites[KILO_MAX_WORKERS];
+  int counts[KILO_MAX_WORKERS];
+};
+
+// the first occurrence of `needle` in [p, end), or NULL
+char *editorEditsFindText(char *p, char *end, const char *needle,
+                          int needle_length) {
+  while (end - p >= needle_length &&
+         (p = memchr(p, needle[0], end - p - needle_length + 1))) {
+    if (memcmp(p, needle, needle_length) == 0) {
+      return p;
+    }
+    p++;
+  }
+  return NULL;
+}
+
+// find the occurrences in each worker's share of the rows, for workers
+// [begin, end)
+void editorEditsFind(void *context, int begin, int end) {
+  struct EditsSearch *search = context;
+  int row_count = search->last - search->first + 1;
+
+  for (int w = begin; w < end; w++) {
+    int count = 0, capacity = 0;
+    struct EditSite *sites = NULL;
+    int first = search->first + (int)((long long)row_count * w /
+                                      search->worker_count);
+    int last = search->first + (int)((long long)row_count * (w + 1) /
+                                     search->worker_count);
+
+    for (int y = first; y < last; y++) {
+      EditorRow *row = &search->rows[y];
+      char *p = row->chars;
+      char *row_end = row->chars + row->size;
+      while ((p = editorEditsFindText(p, row_end, search->from,
+                                      search->from_length))) {
+        if (count == capacity) {
+          capacity = capacity ? capacity * 2 : 64;
+          sites = realloc(sites, sizeof(struct EditSite) * capacity);
+        }
+        sites[count].row = y;
+        sites[count].at = (int)(p - row->chars);
+        sites[count].length = search->from_length;
+        sites[count].text = search->to;
+        sites[count].text_length = search->to_length;
+        count++;
+        p += search->from_length;
+      }
+    }
+    search->sites[w] = sites;
+    search->counts[w] = count;
+  }
+}
+
+int editorReplaceAll(int first, int last, const char *from, int from_length,
+                     const char *to, int to_length) {
+  if (from_length == 0) {
+    return 0;
+  }
+
+  struct EditsSearch search;
+  search.rows = config.rows;
+  search.first = first;
+  search.last = last;
+  search.from = from;
+  search.from_length = from_length;
+  search.to = to;
+  search.to_length = to_length;
+  search.worker_count = editorParallelWorkers(last - first + 1);
+  editorParallelFor(search.worker_count, search.worker_count, editorEditsFind,
+                    &search);
+
+  // the workers' rows are consecutive, so their sites are already in order
+  int count = 0;
+  for (int w = 0; w < search.worker_count; w++) {
+    count += search.counts[w];
+  }
+  struct EditSite *sites = malloc(sizeof(struct EditSite) * (count + 1));
+  for (int w = 0, at = 0; w < search.worker_count; w++) {
+    if (search.counts[w] > 0) {
+      memcpy(&sites[at], search.sites[w],
+             sizeof(struct EditSite) * search.counts[w]);
+      at += search.counts[w];
+    }
+    free(search.sites[w]);
+  }
+
+  editorApplyEdits(sites, count);
+  free(sites);
+  return count;
+}
+
+void editorInsertAtColumn(int first, int last, int column, const char *text,
+                          int text_length) {
+  if (text_length == 0) {
+    return;
+  }
+  int count = last - first + 1;
+  struct EditSite *sites = malloc(sizeof(struct EditSite) * count);
+  for (int j = 0; j < count; j++) {
+    int size = config.rows[first + j].size;
+    sites[j].row = first + j;
+    sites[j].at = column < 0 || column > size ? size : column;
+    sites[j].length = 0;
+    sites[j].text = text;
+    sites[j].text_length = text_length;
+  }
+  editorApplyEdits(sites, count);
+  free(sites);
+}
@@ -0,0 +1,34 @@
+#ifndef edits_h
+#define edits_h
+
+// Applying many small edits at once, e.g. replacing every occurrence of a
+// string or typing at a cursor on each of many lines.
+//
+// All the edit sites are collected first. Then each affected row is rebuilt
+// in one pass and rendered once, on several threads for big batches, and the
+// whole batch is a single undo record. Making the same edits one character at
+// a time would move the rest of the row and re-render it for every character.
+
+// one edit: replace chars [at, at + length) of `row` with `text`
+struct EditSite {
+  int row;
+  int at;
+  int length;
+  const char *text;
+  int text_length;
+};
+
+// Apply `count` edits, sorted by row and then position, that don't overlap.
+void editorApplyEdits(struct EditSite *sites, int count);
+
+// Replace every occurrence of `from` in rows [first, last] with `to`. Returns
+// how many were replaced.
+int editorReplaceAll(int first, int last, const char *from, int from_length,
+                     const char *to, int to_length);
+
+// Insert `text` at `column` (in chars, or the end of the row if it's -1 or
+// past it) of each row in [first, last], as if with a cursor on every row.
+void editorInsertAtColumn(int first, int last, int column, const char *text,
+                          int text_length);
+
+#endif
@@ -0,0 +1,190 @@
+#include "follow.h"
+#include "editor.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+// how many bytes to pull from the file per read
+#define KILO_FOLLOW_CHUNK 65536
+// how often to check the file when inotify is unavailable, in milliseconds
+#define KILO_FOLLOW_POLL_MS 500
+
+// discard every row; used when the followed file is truncated
+void editorFollowReset(void) {
+  editorFreeRows();
+  config.cx = 0;
+  config.cy = 0;
+  config.row_offset = 0;
+  config.col_offset = 0;
+  config.follow_offset = 0;
+  config.follow_partial = 0;
+}
+
+// split freshly read bytes into rows, continuing an unterminated last row
+void editorFollowAppend(char *data, size_t length) {
+  char *p = data;
+  char *end = data + length;
+
+  while (p < end) {
+    char *newline = memchr(p, '\n', end - p);
+    size_t segment = (newline ? newline : end) - p;
+
+    if (config.follow_partial) {
+      editorRowAppendString(&config.rows[config.row_count - 1], p, segment);
+    } else {
+      editorInsertRow(config.row_count, p, segment);
+    }
+
+    config.follow_partial = newline == NULL;
+    if (newline) {
+      // the row is complete; drop the \r of a \r\n line ending
+      EditorRow *row = &config.rows[config.row_count - 1];
+      if (row->size > 0 && row->chars[row->size - 1] == '\r') {
+        editorRowUnshare(row);
+        editorRowBytesChanged(row, -1);
+        row->chars[--row->size] = '\0';
+        editorUpdateRow(row);
+      }
+    }
+    p = newline ? newline + 1 : end;
+  }
+}
+
+// stop watching the file; it's polled instead until it can be watched again
+void editorFollowUnwatch(void) {
+  if (config.follow_watch_fd != -1) {
+    close(config.follow_watch_fd);
+    config.follow_watch_fd = -1;
+  }
+}
+
+// watch the followed path for growth, and for being renamed or deleted (e.g. by
+// log rotation)
+void editorFollowWatch(void) {
+  editorFollowUnwatch();
+#ifdef __linux__
+  config.follow_watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (config.follow_watch_fd != -1 &&
+      inotify_add_watch(config.follow_watch_fd, config.filename,
+                        IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF |
+                            IN_DELETE_SELF) == -1) {
+    editorFollowUnwatch();
+  }
+#endif
+}
+
+// If the path no longer names the file being read (`st`), because it was
+// renamed away or deleted and maybe replaced, open whatever is there now and
+// start over. Returns 1 if it did.
+int editorFollowReopen(struct stat *st) {
+  struct stat path_st;
+  if (stat(config.filename, &path_st) == 0 && path_st.st_dev == st->st_dev &&
+      path_st.st_ino == st->st_ino) {
+    return 0;
+  }
+
+  int fd = open(config.filename, O_RDONLY);
+  if (fd == -1) {
+    // nothing there yet; keep reading the old file, and poll for a new one,
+    // since the watch went with the old file
+    editorFollowUnwatch();
+    return 0;
+  }
+  close(config.follow_fd);
+  config.follow_fd = fd;
+  editorFollowReset();
+  editorFollowWatch();
+  return 1;
+}
+
+void editorFollowStart(char *filename) {
+  free(config.filename);
+  config.filename = strdup(filename);
+  config.read_only = 1;
+
+  config.follow_fd = open(filename, O_RDONLY);
+  if (config.follow_fd == -1) {
+    die("could not open file.");
+  }
+  editorFollowWatch();
+
+  // the initial load is just the first (large) append; it leaves the cursor
+  // pinned to the last line
+  editorFollowUpdate();
+}
+
+int editorFollowUpdate(void) {
+  struct stat st;
+  if (fstat(config.follow_fd, &st) == -1) {
+    return 0;
+  }
+
+  int changed = 0;
+  if (editorFollowReopen(&st)) {
+    // e.g. `create` log rotation: a new file took the old one's place
+    changed = 1;
+  } else if (st.st_size < config.follow_offset) {
+    // the file shrank (e.g. `copytruncate` log rotation); start over
+    editorFollowReset();
+    changed = 1;
+  }
+
+  // stay glued to the end unless the user has scrolled away from it
+  int pinned = config.cy >= config.row_count - 1;
+
+  char buffer[KILO_FOLLOW_CHUNK];
+  ssize_t nread;
+  while ((nread = pread(config.follow_fd, buffer, sizeof(buffer),
+                        config.follow_offset)) > 0) {
+    editorFollowAppend(buffer, (size_t)nread);
+    config.follow_offset += nread;
+    changed = 1;
+  }
+
+  if (changed && pinned) {
+    config.cy = config.row_count > 0 ? config.row_count - 1 : 0;
+    config.cx = 0;
+  }
+
+  // appended rows are the file's own contents, not edits
+  config.dirty = 0;
+  return changed;
+}
+
+int editorFollowWait(void) {
+  int watching = config.follow_watch_fd != -1;
+  struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0},
+                          {config.follow_watch_fd, POLLIN, 0}};
+
+  // without inotify, fall back to checking the file every so often
+  int ready = poll(fds, watching ? 2 : 1, watching ? -1 : KILO_FOLLOW_POLL_MS);
+  if (ready == -1) {
+    if (errno == EINTR) {
+      return 0;
+    }
+    die("could not wait for input.");
+  }
+
+  if (watching) {
+    if (!(fds[1].revents & POLLIN)) {
+      return 0;
+    }
+    // drain the queued events; we only care that something happened
+    char events[4096];
+    while (read(config.follow_watch_fd, events, sizeof(events)) > 0) {
+    }
+  } else if (ready > 0) {
+    return 0;
+  }
+
+  return editorFollowUpdate();
+}
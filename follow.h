@@ -0,0 +1,24 @@
+#ifndef follow_h
+#define follow_h
+
+// Follow mode: show a growing file (e.g. a log) read-only, like `tail -f`.
+// Only newly appended bytes are read, so the cost of following scales with the
+// rate of new data rather than the size of the file.
+//
+// Like `tail -F`, it follows the path rather than the file: when the file is
+// truncated, or renamed away or deleted and another put in its place (log
+// rotation), the rows start over from the file now at the path. Until a new
+// file appears, the old one is still read.
+
+// Open the file at the given path read-only and start watching it for growth.
+void editorFollowStart(char *filename);
+
+// Read any bytes appended since the last update, starting over if the file was
+// truncated or replaced. Returns 1 if rows changed.
+int editorFollowUpdate(void);
+
+// Block until STDIN is readable or the followed file changes. Returns 1 if rows
+// changed and the screen should be redrawn.
+int editorFollowWait(void);
+
+#endif
@@ -1,6 +1,14 @@
+#include "buffers.h"
 #include "editor.h"
+#include "follow.h"
+#include "perf.h"
+#include "script.h"
+#include "trace.h"
 #include "util.h"
 
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <termios.h>
 #include <unistd.h>
 
@@ -57,23 +65,155 @@ void enableRawMode(void) {
 
 #pragma mark -
 
+void usage(char *program) {
+  fprintf(stderr, "usage: %s [options] [file...]\n", program);
+  fprintf(stderr, "       %s --script SCRIPT file...\n", program);
+  fprintf(stderr, "  -f, --follow         follow a growing file read-only\n");
+  fprintf(stderr, "  --record TRACE       record keystrokes to TRACE\n");
+  fprintf(stderr, "  --replay TRACE       replay TRACE headlessly and report "
+                  "per-frame timings\n");
+  fprintf(stderr, "  --realtime           replay at the recorded pace\n");
+  fprintf(stderr, "  --perf-dump FILE     write performance stats to FILE on "
+                  "exit\n");
+  fprintf(stderr, "  --memory-budget MB   drop inactive buffers' rows beyond MB "
+                  "(0 = no limit)\n");
+  fprintf(stderr, "  --script SCRIPT      apply SCRIPT to each file, without a "
+                  "terminal\n");
+  exit(1);
+}
+
 int main(int argc, char *argv[]) {
-  enableRawMode();
+  static struct option long_options[] = {
+      {"follow", no_argument, NULL, 'f'},
+      {"record", required_argument, NULL, 'r'},
+      {"replay", required_argument, NULL, 'p'},
+      {"realtime", no_argument, NULL, 't'},
+      {"perf-dump", required_argument, NULL, 'd'},
+      {"script", required_argument, NULL, 's'},
+      {"memory-budget", required_argument, NULL, 'm'},
+      {NULL, 0, NULL, 0}};
+  int follow = 0;
+  char *record_path = NULL;
+  char *replay_path = NULL;
+  int realtime = 0;
+  char *perf_dump_path = NULL;
+  char *script_path = NULL;
+  int option;
+
+  while ((option = getopt_long(argc, argv, "f", long_options, NULL)) != -1) {
+    switch (option) {
+    case 'f':
+      follow = 1;
+      break;
+    case 'r':
+      record_path = optarg;
+      break;
+    case 'p':
+      replay_path = optarg;
+      break;
+    case 't':
+      realtime = 1;
+      break;
+    case 'd':
+      perf_dump_path = optarg;
+      break;
+    case 's':
+      script_path = optarg;
+      break;
+    case 'm': {
+      char *end;
+      long megabytes = strtol(optarg, &end, 10);
+      if (*end != '\0' || megabytes < 0) {
+        usage(argv[0]);
+      }
+      editorBuffersSetBudget((size_t)megabytes * 1024 * 1024);
+      break;
+    }
+    default:
+      usage(argv[0]);
+    }
+  }
+  if ((follow && optind >= argc) || (follow && optind + 1 < argc) ||
+      (follow && replay_path) ||
+      (record_path && replay_path) || (realtime && !replay_path)) {
+    usage(argv[0]);
+  }
+
+  // batch mode edits files in worker threads and never touches the terminal
+  if (script_path) {
+    if (optind >= argc || follow || record_path || replay_path) {
+      usage(argv[0]);
+    }
+    return editorScriptRun(script_path, &argv[optind], argc - optind);
+  }
+
+  // a replay never touches the terminal; it takes its window size from the
+  // trace
+  if (!replay_path) {
+    enableRawMode();
+  } else if (editorTraceCopyFiles(&argv[optind], argc - optind) == -1) {
+    editorTraceRemoveCopies();
+    perror("could not copy files for replay");
+    return 1;
+  }
   editorInit();
+  if (!replay_path) {
+    editorInitWindowSize();
+  }
 
-  // if we were passed an arg, assume it's a filename to open
-  if (argc >= 2) {
-    editorOpen(argv[1]);
+  // if we were passed args, assume they're filenames to open, each in its own
+  // buffer; the first is shown
+  if (optind < argc) {
+    if (follow) {
+      editorFollowStart(argv[optind]);
+    } else {
+      for (int j = optind; j < argc; j++) {
+        if (editorBufferOpen(argv[j]) == -1) {
+          die("could not open file.");
+        }
+      }
+      editorBufferSwitch(0);
+    }
   }
 
   // the default status message indicates control keys
-  editorSetStatusMessage("HELP: Ctrl-S = save | Ctrl-Q = quit");
+  if (follow) {
+    editorSetStatusMessage("HELP: Ctrl-Q = quit | following %s",
+                           config.filename);
+  } else {
+    editorSetStatusMessage("HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-O = open "
+                           "| Ctrl-B = buffers");
+  }
+
+  if (replay_path) {
+    int replayed = editorTraceReplay(replay_path, realtime);
+    editorTraceRemoveCopies();
+    if (replayed == -1) {
+      perror("could not replay trace");
+      return 1;
+    }
+    if (perf_dump_path && editorPerfDump(perf_dump_path) == -1) {
+      perror("could not write performance stats");
+      return 1;
+    }
+    return 0;
+  }
+
+  if (record_path && editorTraceRecord(record_path) == -1) {
+    die("could not create trace file.");
+  }
 
   // main loop
-  while (1) {
+  do {
     editorRefreshScreen();
-    editorProcessKeypress();
+  } while (editorProcessKeypress());
+
+  editorTraceClose();
+  clearDisplayForStandardOut();
+  repositionCursorToTopLeft();
+  if (perf_dump_path && editorPerfDump(perf_dump_path) == -1) {
+    perror("could not write performance stats");
+    return 1;
   }
-
   return 0;
 }
@@ -0,0 +1,308 @@
+#include "line-cache.h"
+#include "brackets.h"
+#include "editor.h"
+#include "save.h"
+#include "util.h"
+#include "wrap.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// files smaller than this are quicker to scan than to look up
+#define KILO_LINE_CACHE_MIN_SIZE (1 << 20)
+#define KILO_LINE_CACHE_MAGIC "KILOIDX1"
+
+// on disk, the header is followed by `row_count` lengths, then `row_count`
+// line ending sizes
+struct LineCacheHeader {
+  char magic[8];
+  // identity and version of the file this index describes
+  uint64_t device;
+  uint64_t inode;
+  uint64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint64_t row_count;
+  // where the user left off
+  int32_t cx, cy;
+  int32_t row_offset, col_offset;
+};
+
+void editorLineIndexAppend(struct LineIndex *index, uint32_t length,
+                           uint8_t ending) {
+  if (index->count == index->capacity) {
+    index->capacity = index->capacity ? index->capacity * 2 : 1024;
+    index->lengths =
+        realloc(index->lengths, sizeof(uint32_t) * index->capacity);
+    index->endings = realloc(index->endings, index->capacity);
+  }
+  index->lengths[index->count] = length;
+  index->endings[index->count] = ending;
+  index->count++;
+}
+
+void editorLineIndexFree(struct LineIndex *index) {
+  free(index->lengths);
+  free(index->endings);
+}
+
+// writes the cache path for a file into `path`; returns 0 if there is nowhere
+// to keep caches
+int editorLineCachePath(struct stat *st, char *path, size_t path_size) {
+  char directory[4096];
+  char *cache_home = getenv("XDG_CACHE_HOME");
+  char *home = getenv("HOME");
+
+  if (cache_home && cache_home[0]) {
+    snprintf(directory, sizeof(directory), "%s/kilo", cache_home);
+  } else if (home && home[0]) {
+    snprintf(directory, sizeof(directory), "%s/.cache", home);
+    mkdir(directory, 0700);
+    snprintf(directory, sizeof(directory), "%s/.cache/kilo", home);
+  } else {
+    return 0;
+  }
+  if (mkdir(directory, 0700) == -1 && errno != EEXIST) {
+    return 0;
+  }
+
+  int length = snprintf(path, path_size, "%s/%llx-%llx.idx", directory,
+                        (unsigned long long)st->st_dev,
+                        (unsigned long long)st->st_ino);
+  return length > 0 && (size_t)length < path_size;
+}
+
+int editorLineCacheMatches(struct LineCacheHeader *header, struct stat *st) {
+  return memcmp(header->magic, KILO_LINE_CACHE_MAGIC, 8) == 0 &&
+         header->device == (uint64_t)st->st_dev &&
+         header->inode == (uint64_t)st->st_ino &&
+         header->size == (uint64_t)st->st_size &&
+         header->mtime_sec == (int64_t)st->st_mtime &&
+         header->mtime_nsec == (int64_t)KILO_MTIME_NSEC(*st);
+}
+
+void editorLineCacheRestoreCursor(struct LineCacheHeader *header) {
+  if (header->cy < 0 || header->cy > config.row_count) {
+    return;
+  }
+  config.cy = header->cy;
+  int row_length = config.cy < config.row_count ? config.rows[config.cy].size : 0;
+  config.cx = header->cx < 0 ? 0 : header->cx;
+  if (config.cx > row_length) {
+    config.cx = row_length;
+  }
+  // editorScroll pulls these back into view if the window has shrunk
+  config.row_offset = header->row_offset < 0 ? 0 : header->row_offset;
+  config.col_offset = header->col_offset < 0 ? 0 : header->col_offset;
+}
+
+// Read all `length` bytes of `fd` into a new buffer, with room for a NUL
+// after them. Returns NULL on error.
+char *editorLineCacheReadFile(int fd, size_t length) {
+  char *data = malloc(length + 1);
+  size_t done = 0;
+  while (data && done < length) {
+    ssize_t count = pread(fd, &data[done], length - done, done);
+    if (count == -1 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      // the file got shorter underneath us
+      if (count == 0) {
+        errno = EIO;
+      }
+      free(data);
+      return NULL;
+    }
+    done += count;
+  }
+  return data;
+}
+
+// Add the rows the index describes to the (empty) document. Rows without tabs
+// render as they are, so rather than each getting a copy of its text and a
+// render, they all point into `data`, which they share.
+void editorLineCacheAddRows(char *data, uint32_t *lengths, uint8_t *endings,
+                            int row_count) {
+  struct RowShare *share = malloc(sizeof(struct RowShare));
+  share->count = 0;
+  share->buffer = data;
+
+  editorReserveRows(row_count);
+  off_t offset = 0;
+  for (int j = 0; j < row_count; j++) {
+    EditorRow *row = &config.rows[j];
+    char *chars = &data[offset];
+    int newline = endings[j] == 1 && chars[lengths[j]] == '\n';
+    // the line ending becomes the row's terminator
+    chars[lengths[j]] = '\0';
+
+    if (memchr(chars, '\t', lengths[j])) {
+      editorInitRow(row, chars, lengths[j]);
+    } else {
+      row->size = row->render_size = (int)lengths[j];
+      row->chars = row->render = chars;
+      row->wrap_count = 1;
+      row->bracket_closes = row->bracket_opens = -1;
+      row->share = share;
+      share->count++;
+    }
+    editorSaveRowRead(row, offset, newline);
+    offset += lengths[j] + endings[j];
+    config.row_bytes += editorRowBytes(row);
+  }
+
+  config.row_count = row_count;
+  editorWrapRowsSpliced(0, 0, row_count);
+  editorBracketsRowsSpliced(0, 0, row_count);
+  if (share->count == 0) {
+    free(data);
+    free(share);
+  }
+}
+
+int editorLineCacheLoad(char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    return 0;
+  }
+
+  struct stat st;
+  char path[4096];
+  FILE *cache = NULL;
+  uint32_t *lengths = NULL;
+  uint8_t *endings = NULL;
+  char *data = NULL;
+  int loaded = 0;
+
+  if (fstat(fd, &st) == -1 || st.st_size < KILO_LINE_CACHE_MIN_SIZE ||
+      !editorLineCachePath(&st, path, sizeof(path)) ||
+      !(cache = fopen(path, "rb"))) {
+    goto done;
+  }
+
+  struct LineCacheHeader header;
+  if (fread(&header, sizeof(header), 1, cache) != 1 ||
+      !editorLineCacheMatches(&header, &st) || header.row_count > INT32_MAX) {
+    goto done;
+  }
+
+  size_t row_count = header.row_count;
+  lengths = malloc(sizeof(uint32_t) * row_count + 1);
+  endings = malloc(row_count + 1);
+  if (fread(lengths, sizeof(uint32_t), row_count, cache) != row_count ||
+      fread(endings, 1, row_count, cache) != row_count) {
+    goto done;
+  }
+
+  // check the index covers the file exactly before trusting any of it
+  uint64_t total = 0;
+  for (size_t j = 0; j < row_count; j++) {
+    total += (uint64_t)lengths[j] + endings[j];
+  }
+  if (total != (uint64_t)st.st_size) {
+    goto done;
+  }
+
+  // the whole file is read at once, into memory of our own; mapping it
+  // instead would leave the rows open to another program truncating the file
+  data = editorLineCacheReadFile(fd, st.st_size);
+  if (data == NULL) {
+    goto done;
+  }
+  data[st.st_size] = '\0';
+  editorLineCacheAddRows(data, lengths, endings, (int)row_count);
+  editorLineCacheRestoreCursor(&header);
+  loaded = 1;
+
+done:
+  free(lengths);
+  free(endings);
+  if (cache) {
+    fclose(cache);
+  }
+  close(fd);
+  return loaded;
+}
+
+void editorLineCacheFillHeader(struct LineCacheHeader *header,
+                               struct stat *st, uint64_t row_count) {
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, KILO_LINE_CACHE_MAGIC, 8);
+  header->device = st->st_dev;
+  header->inode = st->st_ino;
+  header->size = st->st_size;
+  header->mtime_sec = st->st_mtime;
+  header->mtime_nsec = KILO_MTIME_NSEC(*st);
+  header->row_count = row_count;
+  header->cx = config.cx;
+  header->cy = config.cy;
+  header->row_offset = config.row_offset;
+  header->col_offset = config.col_offset;
+}
+
+void editorLineCacheStore(char *filename, struct LineIndex *index) {
+  struct stat st;
+  char path[4096], temp_path[4096 + 8];
+
+  if (stat(filename, &st) == -1 || st.st_size < KILO_LINE_CACHE_MIN_SIZE ||
+      !editorLineCachePath(&st, path, sizeof(path))) {
+    return;
+  }
+
+  struct LineCacheHeader header;
+  editorLineCacheFillHeader(&header, &st, index->count);
+
+  // write to the side and rename, so a reader never sees half a cache
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+  FILE *cache = fopen(temp_path, "wb");
+  if (!cache) {
+    return;
+  }
+  int ok = fwrite(&header, sizeof(header), 1, cache) == 1 &&
+           fwrite(index->lengths, sizeof(uint32_t), index->count, cache) ==
+               (size_t)index->count &&
+           fwrite(index->endings, 1, index->count, cache) ==
+               (size_t)index->count;
+  if (fclose(cache) != 0 || !ok || rename(temp_path, path) == -1) {
+    unlink(temp_path);
+  }
+}
+
+void editorLineCacheStoreRows(void) {
+  struct LineIndex index = line_index_init;
+  // a save writes every row followed by a single \n
+  for (int j = 0; j < config.row_count; j++) {
+    editorLineIndexAppend(&index, config.rows[j].size, 1);
+  }
+  editorLineCacheStore(config.filename, &index);
+  editorLineIndexFree(&index);
+}
+
+void editorLineCacheStoreCursor(void) {
+  struct stat st;
+  char path[4096];
+
+  if (config.filename == NULL || stat(config.filename, &st) == -1 ||
+      st.st_size < KILO_LINE_CACHE_MIN_SIZE ||
+      !editorLineCachePath(&st, path, sizeof(path))) {
+    return;
+  }
+
+  int fd = open(path, O_RDWR);
+  if (fd == -1) {
+    return;
+  }
+  struct LineCacheHeader header;
+  if (read(fd, &header, sizeof(header)) == sizeof(header) &&
+      editorLineCacheMatches(&header, &st)) {
+    editorLineCacheFillHeader(&header, &st, header.row_count);
+    pwrite(fd, &header, sizeof(header), 0);
+  }
+  close(fd);
+}
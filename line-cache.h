@@ -0,0 +1,48 @@
+#ifndef line_cache_h
+#define line_cache_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A sidecar cache of a file's line structure, so that reopening a large,
+// unchanged file can skip searching every byte for line breaks. Caches live in
+// $XDG_CACHE_HOME/kilo (or ~/.cache/kilo), are keyed by device and inode, and
+// are only trusted while the file's size and mtime still match. A file opened
+// through its cache is read in with a single read, and its rows share that
+// buffer rather than each allocating and rendering its own text.
+
+// the line structure of a file, in file order
+struct LineIndex {
+  // the length of each row, without its line ending
+  uint32_t *lengths;
+  // how many line ending bytes (\n, \r\n, ...) followed each row
+  uint8_t *endings;
+  int count;
+  int capacity;
+};
+
+#define line_index_init {NULL, NULL, 0, 0}
+
+void editorLineIndexAppend(struct LineIndex *index, uint32_t length,
+                           uint8_t ending);
+void editorLineIndexFree(struct LineIndex *index);
+
+// Load the rows of `filename` from its cached index, restoring the cursor and
+// scroll position. Returns 0 (with no rows loaded) if there is no valid cache.
+int editorLineCacheLoad(char *filename);
+
+// Read all `length` bytes of `fd` into a new buffer, with room for a NUL after
+// them. Returns NULL if there were fewer (say, the file was truncated) or on
+// error.
+char *editorLineCacheReadFile(int fd, size_t length);
+
+// Cache the line index of `filename` along with the current cursor.
+void editorLineCacheStore(char *filename, struct LineIndex *index);
+
+// Cache the current rows, as just written to `config.filename` by a save.
+void editorLineCacheStoreRows(void);
+
+// Remember the cursor and scroll position in an existing, still valid cache.
+void editorLineCacheStoreCursor(void);
+
+#endif
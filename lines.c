@@ -0,0 +1,429 @@
+#include "lines.h"
+#include "editor.h"
+#include "edits.h"
+#include "parallel.h"
+#include "undo.h"
+#include "util.h"
+
+#include <ctype.h>
+#include <regex.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#pragma mark - Sorting
+
+// a row, and where it was before sorting, which keeps the sort stable
+struct LineHandle {
+  EditorRow *row;
+  int index;
+};
+
+int editorLinesCompareRows(EditorRow *a, EditorRow *b) {
+  int length = a->size < b->size ? a->size : b->size;
+  int order = memcmp(a->chars, b->chars, length);
+  return order ? order : (a->size > b->size) - (a->size < b->size);
+}
+
+int editorLinesCompare(const void *a, const void *b) {
+  const struct LineHandle *x = a, *y = b;
+  int order = editorLinesCompareRows(x->row, y->row);
+  return order ? order : x->index - y->index;
+}
+
+int editorLinesCompareReverse(const void *a, const void *b) {
+  const struct LineHandle *x = a, *y = b;
+  int order = editorLinesCompareRows(y->row, x->row);
+  return order ? order : x->index - y->index;
+}
+
+struct LinesSort {
+  struct LineHandle *handles;
+  struct LineHandle *scratch;
+  int (*compare)(const void *, const void *);
+  // the sorted runs; run j is [bounds[j], bounds[j + 1])
+  int bounds[KILO_MAX_WORKERS + 1];
+  int run_count;
+};
+
+// sort each run in [begin, end)
+void editorLinesSortRuns(void *context, int begin, int end) {
+  struct LinesSort *sort = context;
+  for (int j = begin; j < end; j++) {
+    qsort(&sort->handles[sort->bounds[j]], sort->bounds[j + 1] - sort->bounds[j],
+          sizeof(struct LineHandle), sort->compare);
+  }
+}
+
+// merge runs 2j and 2j + 1 into the scratch array, for each j in [begin, end)
+void editorLinesMergeRuns(void *context, int begin, int end) {
+  struct LinesSort *sort = context;
+  for (int j = begin; j < end; j++) {
+    int left = sort->bounds[2 * j];
+    int middle = sort->bounds[2 * j + 1];
+    int right = sort->bounds[2 * j + 2];
+    int a = left, b = middle, out = left;
+    while (a < middle && b < right) {
+      if (sort->compare(&sort->handles[b], &sort->handles[a]) < 0) {
+        sort->scratch[out++] = sort->handles[b++];
+      } else {
+        sort->scratch[out++] = sort->handles[a++];
+      }
+    }
+    memcpy(&sort->scratch[out], &sort->handles[a],
+           sizeof(struct LineHandle) * (middle - a));
+    out += middle - a;
+    memcpy(&sort->scratch[out], &sort->handles[b],
+           sizeof(struct LineHandle) * (right - b));
+  }
+}
+
+// Sort `n` handles: each worker sorts a run, then pairs of runs are merged in
+// parallel until one is left.
+void editorLinesSort(struct LineHandle *handles, int n, int descending) {
+  struct LinesSort sort;
+  sort.handles = handles;
+  sort.scratch = malloc(sizeof(struct LineHandle) * (n + 1));
+  sort.compare = descending ? editorLinesCompareReverse : editorLinesCompare;
+  sort.run_count = editorParallelWorkers(n);
+  for (int j = 0; j <= sort.run_count; j++) {
+    sort.bounds[j] = (int)((int64_t)n * j / sort.run_count);
+  }
+
+  editorParallelFor(sort.run_count, sort.run_count, editorLinesSortRuns,
+                      &sort);
+
+  while (sort.run_count > 1) {
+    int pairs = sort.run_count / 2;
+    editorParallelFor(pairs, pairs, editorLinesMergeRuns, &sort);
+    // an odd run out is carried over unmerged
+    if (sort.run_count % 2) {
+      int left = sort.bounds[sort.run_count - 1];
+      int right = sort.bounds[sort.run_count];
+      memcpy(&sort.scratch[left], &sort.handles[left],
+             sizeof(struct LineHandle) * (right - left));
+    }
+
+    struct LineHandle *merged = sort.scratch;
+    sort.scratch = sort.handles;
+    sort.handles = merged;
+    for (int j = 0; j < pairs; j++) {
+      sort.bounds[j + 1] = sort.bounds[2 * j + 2];
+    }
+    if (sort.run_count % 2) {
+      sort.bounds[pairs + 1] = sort.bounds[sort.run_count];
+    }
+    sort.run_count = pairs + sort.run_count % 2;
+  }
+
+  if (sort.handles != handles) {
+    memcpy(handles, sort.handles, sizeof(struct LineHandle) * n);
+    sort.scratch = sort.handles;
+  }
+  free(sort.scratch);
+}
+
+#pragma mark - Filtering
+
+struct LinesFilter {
+  EditorRow *rows;
+  char *keep;
+  // keep/drop
+  const char *pattern;
+  int invert;
+  // uniq
+  uint64_t *hashes;
+};
+
+void editorLinesMatch(void *context, int begin, int end) {
+  struct LinesFilter *filter = context;
+  // glibc serializes regexec on a shared pattern, so each worker compiles its
+  // own; the pattern was already checked to compile
+  regex_t regex;
+  regcomp(&regex, filter->pattern, REG_EXTENDED | REG_NOSUB);
+  for (int j = begin; j < end; j++) {
+    int match = regexec(&regex, filter->rows[j].chars, 0, NULL, 0) == 0;
+    filter->keep[j] = match != filter->invert;
+  }
+  regfree(&regex);
+}
+
+void editorLinesHash(void *context, int begin, int end) {
+  struct LinesFilter *filter = context;
+  for (int j = begin; j < end; j++) {
+    filter->hashes[j] = hashBytes(filter->rows[j].chars, filter->rows[j].size);
+  }
+}
+
+// mark the first occurrence of each distinct line to be kept
+void editorLinesMarkUnique(struct LinesFilter *filter, int n) {
+  filter->hashes = malloc(sizeof(uint64_t) * (n + 1));
+  editorParallelFor(editorParallelWorkers(n), n, editorLinesHash, filter);
+
+  // an open-addressed set of the lines kept so far, as indexes + 1
+  size_t capacity = 16;
+  while (capacity < (size_t)n * 2) {
+    capacity *= 2;
+  }
+  int *slots = calloc(capacity, sizeof(int));
+
+  for (int j = 0; j < n; j++) {
+    size_t slot = filter->hashes[j] & (capacity - 1);
+    filter->keep[j] = 1;
+    while (slots[slot]) {
+      int seen = slots[slot] - 1;
+      if (filter->hashes[seen] == filter->hashes[j] &&
+          editorLinesCompareRows(&filter->rows[seen], &filter->rows[j]) == 0) {
+        filter->keep[j] = 0;
+        break;
+      }
+      slot = (slot + 1) & (capacity - 1);
+    }
+    if (filter->keep[j]) {
+      slots[slot] = j + 1;
+    }
+  }
+
+  free(slots);
+  free(filter->hashes);
+}
+
+#pragma mark - Applying
+
+// Reorder rows [at, at + n) so that new row j is old row source[j]. Takes
+// ownership of `source`. Returns 0 if the order didn't change.
+int editorLinesApplyOrder(int at, int n, int *source) {
+  int j = 0;
+  while (j < n && source[j] == j) {
+    j++;
+  }
+  if (j >= n) {
+    free(source);
+    return 0;
+  }
+
+  EditorRow *rows = malloc(sizeof(EditorRow) * n);
+  for (j = 0; j < n; j++) {
+    rows[j] = config.rows[at + source[j]];
+  }
+  editorUndoRecordRows(at, n, source, n, NULL, 0);
+  editorSpliceRows(at, n, rows, n);
+  free(rows);
+  return 1;
+}
+
+// Remove the rows in [at, at + n) that aren't marked in `keep`. Returns how
+// many were removed.
+int editorLinesApplyKeep(int at, int n, char *keep) {
+  int kept_count = 0;
+  for (int j = 0; j < n; j++) {
+    kept_count += keep[j];
+  }
+  if (kept_count >= n) {
+    return 0;
+  }
+
+  EditorRow *kept = malloc(sizeof(EditorRow) * (kept_count + 1));
+  int *source = malloc(sizeof(int) * (kept_count + 1));
+  EditorRow *removed = malloc(sizeof(EditorRow) * (n - kept_count));
+  for (int j = 0, k = 0, r = 0; j < n; j++) {
+    if (keep[j]) {
+      source[k] = j;
+      kept[k++] = config.rows[at + j];
+    } else {
+      removed[r++] = config.rows[at + j];
+    }
+  }
+  editorUndoRecordRows(at, n, source, kept_count, removed, n - kept_count);
+  editorSpliceRows(at, n, kept, kept_count);
+  free(kept);
+  return n - kept_count;
+}
+
+#pragma mark - Commands
+
+// parse a line address; returns -1 if there isn't one
+int editorLinesParseAddress(char **p) {
+  if (**p == '.') {
+    (*p)++;
+    return config.cy + 1;
+  }
+  if (**p == '$') {
+    (*p)++;
+    return config.row_count;
+  }
+  if (isdigit((unsigned char)**p)) {
+    return (int)strtol(*p, p, 10);
+  }
+  return -1;
+}
+
+// Parse and run `s/FROM/TO/` on rows [first, last] (1-based). The text is
+// literal; the closing delimiter is optional.
+int editorLinesSubstitute(char *command, int first, int last) {
+  char delimiter = command[1];
+  char *from = &command[2];
+  char *to = strchr(from, delimiter);
+  if (to == NULL || to == from) {
+    editorSetStatusMessage("Usage: s%cFROM%cTO%c", delimiter, delimiter,
+                           delimiter);
+    return -1;
+  }
+  int from_length = (int)(to - from);
+  to++;
+  char *end = strchr(to, delimiter);
+  int to_length = end ? (int)(end - to) : (int)strlen(to);
+  if (end && end[1] != '\0') {
+    editorSetStatusMessage("Trailing characters after s%c...%c", delimiter,
+                           delimiter);
+    return -1;
+  }
+
+  int count =
+      editorReplaceAll(first - 1, last - 1, from, from_length, to, to_length);
+  if (count == 0) {
+    editorSetStatusMessage("Not found: %.*s", from_length, from);
+    return 0;
+  }
+  editorSetStatusMessage("Replaced %d occurrence%s.", count,
+                         count == 1 ? "" : "s");
+  // the cursor's column may be past the end of its row now
+  if (config.cy < config.row_count && config.cx > config.rows[config.cy].size) {
+    config.cx = config.rows[config.cy].size;
+  }
+  return 0;
+}
+
+int editorLineCommand(char *command) {
+  char *p = command;
+  while (*p == ' ') {
+    p++;
+  }
+
+  int first = 1, last = config.row_count;
+  int address = editorLinesParseAddress(&p);
+  if (address != -1) {
+    first = last = address;
+    if (*p == ',') {
+      p++;
+      last = editorLinesParseAddress(&p);
+    }
+    if (first < 1 || last > config.row_count || first > last) {
+      editorSetStatusMessage("Bad range; the document has %d lines.",
+                             config.row_count);
+      return -1;
+    }
+  }
+  if (config.row_count == 0) {
+    editorSetStatusMessage("No lines.");
+    return -1;
+  }
+
+  while (*p == ' ') {
+    p++;
+  }
+  int at = first - 1;
+  int n = last - first + 1;
+  EditorRow *rows = &config.rows[at];
+
+  // s/FROM/TO/ takes any punctuation as the delimiter, and its text may have
+  // spaces in it
+  if (p[0] == 's' && ispunct((unsigned char)p[1])) {
+    return editorLinesSubstitute(p, first, last);
+  }
+
+  char *name = p;
+  while (*p && *p != ' ') {
+    p++;
+  }
+  int name_length = (int)(p - name);
+  // inserted text keeps any spaces after the first
+  char *text = *p == ' ' ? p + 1 : p;
+  while (*p == ' ') {
+    p++;
+  }
+  char *argument = p;
+
+  if ((name_length == 6 && strncmp(name, "insert", 6) == 0) ||
+      (name_length == 6 && strncmp(name, "append", 6) == 0)) {
+    if (*text == '\0') {
+      editorSetStatusMessage("Nothing to %.*s.", name_length, name);
+      return -1;
+    }
+    // the cursor's column on every line, or the end of every line
+    int column = name[0] == 'i' ? config.cx : -1;
+    editorInsertAtColumn(at, last - 1, column, text, (int)strlen(text));
+    editorSetStatusMessage("Edited %d lines.", n);
+    config.cy = at;
+    config.cx = column < 0 ? 0 : column;
+    return 0;
+  }
+
+  if ((name_length == 4 && strncmp(name, "sort", 4) == 0) ||
+      (name_length == 5 && strncmp(name, "rsort", 5) == 0)) {
+    struct LineHandle *handles = malloc(sizeof(struct LineHandle) * n);
+    for (int j = 0; j < n; j++) {
+      handles[j].row = &rows[j];
+      handles[j].index = j;
+    }
+    editorLinesSort(handles, n, name[0] == 'r');
+    int *source = malloc(sizeof(int) * n);
+    for (int j = 0; j < n; j++) {
+      source[j] = handles[j].index;
+    }
+    free(handles);
+    int changed = editorLinesApplyOrder(at, n, source);
+    editorSetStatusMessage(changed ? "Sorted %d lines."
+                                   : "%d lines already sorted.",
+                           n);
+  } else if (name_length == 7 && strncmp(name, "reverse", 7) == 0) {
+    int *source = malloc(sizeof(int) * n);
+    for (int j = 0; j < n; j++) {
+      source[j] = n - 1 - j;
+    }
+    editorLinesApplyOrder(at, n, source);
+    editorSetStatusMessage("Reversed %d lines.", n);
+  } else if ((name_length == 4 && strncmp(name, "uniq", 4) == 0) ||
+             (name_length == 4 && strncmp(name, "keep", 4) == 0) ||
+             (name_length == 4 && strncmp(name, "drop", 4) == 0)) {
+    struct LinesFilter filter;
+    filter.rows = rows;
+    filter.keep = malloc(n);
+    if (name[0] == 'u') {
+      editorLinesMarkUnique(&filter, n);
+    } else {
+      regex_t regex;
+      if (*argument == '\0' ||
+          regcomp(&regex, argument, REG_EXTENDED | REG_NOSUB) != 0) {
+        editorSetStatusMessage("Bad pattern: %s", argument);
+        free(filter.keep);
+        return -1;
+      }
+      regfree(&regex);
+      filter.pattern = argument;
+      filter.invert = name[0] == 'd';
+      editorParallelFor(editorParallelWorkers(n), n, editorLinesMatch,
+                          &filter);
+    }
+    int removed = editorLinesApplyKeep(at, n, filter.keep);
+    free(filter.keep);
+    editorSetStatusMessage("Removed %d of %d lines.", removed, n);
+  } else {
+    editorSetStatusMessage("Unknown command: %.*s", name_length, name);
+    return -1;
+  }
+
+  config.cy = at;
+  config.cx = 0;
+  return 0;
+}
+
+void editorLineCommandPrompt(void) {
+  char *command = editorPrompt("Lines: %s (sort|rsort|reverse|uniq|keep "
+                               "RE|drop RE|s/A/B/|insert T|append T)");
+  if (command == NULL) {
+    return;
+  }
+  editorLineCommand(command);
+  free(command);
+}
@@ -0,0 +1,31 @@
+#ifndef lines_h
+#define lines_h
+
+// Line commands: reordering and filtering whole lines in place, over the
+// whole document or a range of it, e.g. `sort`, `10,$ uniq` or `.,20 drop ^#`.
+//
+// A range is one or two addresses separated by a comma: a line number, `.`
+// for the cursor's line or `$` for the last. The commands are
+//
+//   sort, rsort      sort lines by their bytes, ascending or descending
+//   reverse          reverse the order of lines
+//   uniq             remove every repeat of an earlier line
+//   keep PATTERN     keep only lines matching an extended regex
+//   drop PATTERN     remove lines matching an extended regex
+//   s/FROM/TO/       replace every occurrence of FROM with TO; both are
+//                    literal text, and any punctuation can be the delimiter
+//   insert TEXT      insert TEXT at the cursor's column on every line
+//   append TEXT      add TEXT to the end of every line
+//
+// Large ranges are sorted and filtered on several threads. Rows are moved, not
+// copied, and each command can be undone in one step. The last three edit text
+// within lines through edits.h.
+
+// Prompt for a line command and run it.
+void editorLineCommandPrompt(void);
+
+// Run a line command. Returns -1 (after telling the user why) if it couldn't
+// run.
+int editorLineCommand(char *command);
+
+#endif
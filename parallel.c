@@ -0,0 +1,55 @@
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+struct ParallelJob {
+  void (*work)(void *context, int begin, int end);
+  void *context;
+  int begin, end;
+};
+
+void *editorParallelRunJob(void *argument) {
+  struct ParallelJob *job = argument;
+  job->work(job->context, job->begin, job->end);
+  return NULL;
+}
+
+int editorParallelWorkers(int item_count) {
+  if (item_count < KILO_PARALLEL_MIN_ITEMS) {
+    return 1;
+  }
+  long workers = sysconf(_SC_NPROCESSORS_ONLN);
+  if (workers < 1) {
+    return 1;
+  }
+  return workers > KILO_MAX_WORKERS ? KILO_MAX_WORKERS : (int)workers;
+}
+
+void editorParallelFor(int workers, int n,
+                       void (*work)(void *context, int begin, int end),
+                       void *context) {
+  struct ParallelJob jobs[KILO_MAX_WORKERS];
+  pthread_t threads[KILO_MAX_WORKERS];
+  int started[KILO_MAX_WORKERS];
+
+  for (int w = 0; w < workers; w++) {
+    jobs[w].work = work;
+    jobs[w].context = context;
+    jobs[w].begin = (int)((int64_t)n * w / workers);
+    jobs[w].end = (int)((int64_t)n * (w + 1) / workers);
+    started[w] = w > 0 && pthread_create(&threads[w], NULL,
+                                         editorParallelRunJob, &jobs[w]) == 0;
+  }
+  for (int w = 0; w < workers; w++) {
+    if (!started[w]) {
+      editorParallelRunJob(&jobs[w]);
+    }
+  }
+  for (int w = 1; w < workers; w++) {
+    if (started[w]) {
+      pthread_join(threads[w], NULL);
+    }
+  }
+}
@@ -0,0 +1,22 @@
+#ifndef parallel_h
+#define parallel_h
+
+// Splitting work on many rows across threads.
+
+// below this many items, threads cost more than they save
+#define KILO_PARALLEL_MIN_ITEMS 16384
+#define KILO_MAX_WORKERS 16
+
+// How many workers to use for `item_count` items: 1 for small jobs, otherwise
+// one per core, up to KILO_MAX_WORKERS.
+int editorParallelWorkers(int item_count);
+
+// Split [0, n) into `workers` even parts and call `work` on each, one per
+// thread. The calling thread takes the first part, and any part a thread
+// couldn't be started for. Workers see their own (empty) `config`, so `work`
+// must only use what it's given through `context`.
+void editorParallelFor(int workers, int n,
+                       void (*work)(void *context, int begin, int end),
+                       void *context);
+
+#endif
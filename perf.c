@@ -0,0 +1,199 @@
+#include "perf.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// one bucket per power of two: bucket b holds values in [2^b, 2^(b+1))
+#define PERF_BUCKETS 40
+// the overlay draws buckets from 128ns up to about half a second
+#define PERF_OVERLAY_FIRST_BUCKET 7
+#define PERF_OVERLAY_BUCKETS 22
+
+struct PerfHistogram {
+  uint64_t count;
+  uint64_t total;
+  uint64_t max;
+  uint64_t buckets[PERF_BUCKETS];
+};
+
+struct EditorPerf {
+  struct PerfHistogram stats[PERF_STAT_COUNT];
+  uint64_t counters[PERF_COUNTER_COUNT];
+  int overlay;
+};
+
+_Thread_local struct EditorPerf perf;
+
+const char *perf_stat_names[PERF_STAT_COUNT] = {
+    "input", "keypress", "scroll", "draw_rows", "write", "frame_bytes"};
+const char *perf_counter_names[PERF_COUNTER_COUNT] = {"frames", "reallocs",
+                                                      "row_renders"};
+
+uint64_t editorPerfNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void editorPerfAdd(enum PerfStat stat, uint64_t value) {
+  struct PerfHistogram *histogram = &perf.stats[stat];
+  int bucket = 63 - __builtin_clzll(value | 1);
+  if (bucket >= PERF_BUCKETS) {
+    bucket = PERF_BUCKETS - 1;
+  }
+  histogram->buckets[bucket]++;
+  histogram->count++;
+  histogram->total += value;
+  if (value > histogram->max) {
+    histogram->max = value;
+  }
+}
+
+void editorPerfRecord(enum PerfStat stat, uint64_t start) {
+  editorPerfAdd(stat, editorPerfNow() - start);
+}
+
+void editorPerfCount(enum PerfCounter counter) { perf.counters[counter]++; }
+
+void editorPerfToggleOverlay(void) { perf.overlay = !perf.overlay; }
+
+// an upper bound on the given percentile, from the histogram
+uint64_t editorPerfPercentile(struct PerfHistogram *histogram, int percentile) {
+  uint64_t wanted = (histogram->count * percentile + 99) / 100;
+  uint64_t seen = 0;
+  for (int b = 0; b < PERF_BUCKETS; b++) {
+    seen += histogram->buckets[b];
+    if (seen >= wanted && seen > 0) {
+      uint64_t bound = 2ULL << b;
+      return bound < histogram->max ? bound : histogram->max;
+    }
+  }
+  return histogram->max;
+}
+
+// format a latency (or, for bytes, a size) in a few characters
+void editorPerfFormat(char *buf, size_t size, uint64_t value, int is_bytes) {
+  if (is_bytes) {
+    if (value < 10000) {
+      snprintf(buf, size, "%lluB", (unsigned long long)value);
+    } else {
+      snprintf(buf, size, "%lluK", (unsigned long long)value / 1024);
+    }
+  } else if (value < 10000) {
+    snprintf(buf, size, "%lluns", (unsigned long long)value);
+  } else if (value < 10000000) {
+    snprintf(buf, size, "%lluus", (unsigned long long)value / 1000);
+  } else {
+    snprintf(buf, size, "%llums", (unsigned long long)value / 1000000);
+  }
+}
+
+void editorPerfDrawStat(struct append_buffer *ab, enum PerfStat stat,
+                        int cols) {
+  struct PerfHistogram *histogram = &perf.stats[stat];
+  int is_bytes = stat == PERF_FRAME_BYTES;
+  char p50[16], p99[16], max[16];
+  editorPerfFormat(p50, sizeof(p50), editorPerfPercentile(histogram, 50),
+                   is_bytes);
+  editorPerfFormat(p99, sizeof(p99), editorPerfPercentile(histogram, 99),
+                   is_bytes);
+  editorPerfFormat(max, sizeof(max), histogram->max, is_bytes);
+
+  // a sparkline of the histogram, scaled to its fullest bucket
+  static const char levels[] = " .:-=+*#%@";
+  int first = is_bytes ? 4 : PERF_OVERLAY_FIRST_BUCKET;
+  uint64_t fullest = 1;
+  for (int b = first; b < first + PERF_OVERLAY_BUCKETS; b++) {
+    if (histogram->buckets[b] > fullest) {
+      fullest = histogram->buckets[b];
+    }
+  }
+  char spark[PERF_OVERLAY_BUCKETS + 1];
+  for (int b = 0; b < PERF_OVERLAY_BUCKETS; b++) {
+    uint64_t n = histogram->buckets[first + b];
+    spark[b] = levels[n ? 1 + n * (sizeof(levels) - 3) / fullest : 0];
+  }
+  spark[PERF_OVERLAY_BUCKETS] = '\0';
+
+  char line[160];
+  int length =
+      snprintf(line, sizeof(line), " %-11s p50 %-7s p99 %-7s max %-7s [%s]",
+               perf_stat_names[stat], p50, p99, max, spark);
+  if (length > cols) {
+    length = cols;
+  }
+  append_buffer_append(ab, line, length);
+}
+
+void editorPerfDrawOverlay(struct append_buffer *ab, int rows, int cols) {
+  if (!perf.overlay) {
+    return;
+  }
+
+  int height = PERF_STAT_COUNT + 1;
+  if (rows < height) {
+    return;
+  }
+
+  char buf[32];
+  for (int y = 0; y < height; y++) {
+    // jump to the row and draw it in reverse video
+    snprintf(buf, sizeof(buf), "\x1b[%d;1H\x1b[7m", rows - height + y + 1);
+    append_buffer_append(ab, buf, (int)strlen(buf));
+
+    if (y < PERF_STAT_COUNT) {
+      editorPerfDrawStat(ab, (enum PerfStat)y, cols);
+    } else {
+      uint64_t frames = perf.counters[PERF_FRAMES] ? perf.counters[PERF_FRAMES]
+                                                   : 1;
+      char line[160];
+      int length = snprintf(
+          line, sizeof(line),
+          " %llu frames | %.1f reallocs/frame | %.1f row renders/frame",
+          (unsigned long long)perf.counters[PERF_FRAMES],
+          (double)perf.counters[PERF_REALLOCS] / frames,
+          (double)perf.counters[PERF_ROW_RENDERS] / frames);
+      if (length > cols) {
+        length = cols;
+      }
+      append_buffer_append(ab, line, length);
+    }
+    append_buffer_append(ab, "\x1b[K\x1b[m", 6);
+  }
+}
+
+int editorPerfDump(char *path) {
+  FILE *fp = fopen(path, "w");
+  if (!fp) {
+    return -1;
+  }
+
+  fprintf(fp, "{\"stats\":{");
+  for (int s = 0; s < PERF_STAT_COUNT; s++) {
+    struct PerfHistogram *histogram = &perf.stats[s];
+    fprintf(fp,
+            "%s\"%s\":{\"count\":%llu,\"total\":%llu,\"max\":%llu,"
+            "\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"histogram\":[",
+            s ? "," : "", perf_stat_names[s],
+            (unsigned long long)histogram->count,
+            (unsigned long long)histogram->total,
+            (unsigned long long)histogram->max,
+            (unsigned long long)editorPerfPercentile(histogram, 50),
+            (unsigned long long)editorPerfPercentile(histogram, 90),
+            (unsigned long long)editorPerfPercentile(histogram, 99));
+    for (int b = 0; b < PERF_BUCKETS; b++) {
+      fprintf(fp, "%s%llu", b ? "," : "",
+              (unsigned long long)histogram->buckets[b]);
+    }
+    fprintf(fp, "]}");
+  }
+  fprintf(fp, "},\"counters\":{");
+  for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+    fprintf(fp, "%s\"%s\":%llu", c ? "," : "", perf_counter_names[c],
+            (unsigned long long)perf.counters[c]);
+  }
+  fprintf(fp, "}}\n");
+
+  return fclose(fp) == 0 ? 0 : -1;
+}
@@ -0,0 +1,47 @@
+#ifndef perf_h
+#define perf_h
+
+#include "append-buffer.h"
+
+#include <stdint.h>
+
+// Low-overhead instrumentation of the editor's hot paths: latency histograms
+// for each stage of a frame, and counters for the work done along the way.
+
+// stages of handling a keypress and redrawing; the first stats are latencies
+// in nanoseconds, the last is a size in bytes
+enum PerfStat {
+  PERF_INPUT,
+  PERF_KEYPRESS,
+  PERF_SCROLL,
+  PERF_DRAW_ROWS,
+  PERF_WRITE,
+  PERF_FRAME_BYTES,
+  PERF_STAT_COUNT
+};
+
+enum PerfCounter {
+  PERF_FRAMES,
+  PERF_REALLOCS,
+  PERF_ROW_RENDERS,
+  PERF_COUNTER_COUNT
+};
+
+// a monotonic timestamp in nanoseconds
+uint64_t editorPerfNow(void);
+
+// Add a sample to a stat's histogram.
+void editorPerfAdd(enum PerfStat stat, uint64_t value);
+// Add the time elapsed since `start` to a latency stat.
+void editorPerfRecord(enum PerfStat stat, uint64_t start);
+void editorPerfCount(enum PerfCounter counter);
+
+// Show or hide the overlay.
+void editorPerfToggleOverlay(void);
+// Draw the overlay, if shown, over the bottom `rows` rows of the text area.
+void editorPerfDrawOverlay(struct append_buffer *ab, int rows, int cols);
+
+// Write every stat and counter to `path` as JSON. Returns -1 on error.
+int editorPerfDump(char *path);
+
+#endif
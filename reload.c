@@ -0,0 +1,280 @@
+#include "reload.h"
+#include "line-cache.h"
+#include "save.h"
+#include "undo.h"
+#include "util.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// check the disk at most this often while idle, in seconds
+#define KILO_RELOAD_CHECK_INTERVAL 1
+
+// a line of the file on disk
+struct DiskLine {
+  char *start;
+  int length;
+  uint64_t hash;
+};
+
+int editorStatFile(char *path, struct FileStamp *stamp) {
+  struct stat st;
+  if (stat(path, &st) == -1) {
+    return -1;
+  }
+  stamp->device = st.st_dev;
+  stamp->inode = st.st_ino;
+  stamp->size = st.st_size;
+  stamp->mtime_sec = st.st_mtime;
+  stamp->mtime_nsec = KILO_MTIME_NSEC(st);
+  return 0;
+}
+
+void editorRecordFileStamp(void) {
+  memset(&config.file_stamp, 0, sizeof(config.file_stamp));
+  if (config.filename) {
+    editorStatFile(config.filename, &config.file_stamp);
+  }
+  config.file_change_warned = 0;
+}
+
+int editorFileChangedOnDisk(void) {
+  struct FileStamp stamp;
+  if (config.filename == NULL || editorStatFile(config.filename, &stamp) == -1) {
+    // a missing file can't be reloaded; saving will simply recreate it
+    return 0;
+  }
+  return stamp.device != config.file_stamp.device ||
+         stamp.inode != config.file_stamp.inode ||
+         stamp.size != config.file_stamp.size ||
+         stamp.mtime_sec != config.file_stamp.mtime_sec ||
+         stamp.mtime_nsec != config.file_stamp.mtime_nsec;
+}
+
+// split a file into lines the same way editorOpen does
+struct DiskLine *editorSplitLines(char *data, size_t size, int *line_count) {
+  int count = 0;
+  int capacity = 1024;
+  struct DiskLine *lines = malloc(sizeof(struct DiskLine) * capacity);
+
+  char *p = data;
+  char *end = data + size;
+  while (p < end) {
+    char *newline = memchr(p, '\n', end - p);
+    int length = (int)((newline ? newline : end) - p);
+    while (length > 0 && p[length - 1] == '\r') {
+      length--;
+    }
+
+    if (count == capacity) {
+      capacity *= 2;
+      lines = realloc(lines, sizeof(struct DiskLine) * capacity);
+    }
+    lines[count].start = p;
+    lines[count].length = length;
+    lines[count].hash = 0;
+    count++;
+
+    p = newline ? newline + 1 : end;
+  }
+
+  *line_count = count;
+  return lines;
+}
+
+int editorRowMatchesLine(EditorRow *row, struct DiskLine *line) {
+  return row->size == line->length &&
+         memcmp(row->chars, line->start, line->length) == 0;
+}
+
+// where a row of the old middle region ended up, or -1 if it was dropped
+void editorReloadMoveCursor(int *y, int prefix, int old_end, int delta,
+                            int *moved_to) {
+  if (*y < prefix) {
+    return;
+  }
+  if (*y >= old_end) {
+    *y += delta;
+  } else if (moved_to[*y - prefix] != -1) {
+    *y = moved_to[*y - prefix];
+  } else if (*y > old_end + delta) {
+    *y = old_end + delta;
+  }
+}
+
+int editorReloadChanged(void) {
+  if (config.filename == NULL) {
+    return -1;
+  }
+  int fd = open(config.filename, O_RDONLY);
+  if (fd == -1) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return -1;
+  }
+
+  // the file is being rewritten as we speak, so it's read into memory of our
+  // own; a mapping would fault if the other program truncated it
+  char *data = editorLineCacheReadFile(fd, st.st_size);
+  if (data == NULL) {
+    close(fd);
+    return -1;
+  }
+
+  int line_count;
+  struct DiskLine *lines = editorSplitLines(data, st.st_size, &line_count);
+
+  // rows at either end that are unchanged are left exactly where they are
+  int prefix = 0;
+  while (prefix < config.row_count && prefix < line_count &&
+         editorRowMatchesLine(&config.rows[prefix], &lines[prefix])) {
+    prefix++;
+  }
+  int suffix = 0;
+  while (suffix < config.row_count - prefix && suffix < line_count - prefix &&
+         editorRowMatchesLine(&config.rows[config.row_count - 1 - suffix],
+                              &lines[line_count - 1 - suffix])) {
+    suffix++;
+  }
+
+  int old_count = config.row_count - prefix - suffix;
+  int new_count = line_count - prefix - suffix;
+  int read_count = 0;
+
+  if (old_count > 0 || new_count > 0) {
+    // hash the old middle rows into chains so that rows which merely moved
+    // (e.g. because lines were inserted above them) can be reused instead of
+    // being read and rendered again
+    int buckets = 1;
+    while (buckets < old_count * 2) {
+      buckets *= 2;
+    }
+    int *heads = malloc(sizeof(int) * buckets);
+    int *next = malloc(sizeof(int) * (old_count + 1));
+    uint64_t *hashes = malloc(sizeof(uint64_t) * (old_count + 1));
+    int *moved_to = malloc(sizeof(int) * (old_count + 1));
+    for (int j = 0; j < buckets; j++) {
+      heads[j] = -1;
+    }
+    // insert backwards so every chain is in ascending row order
+    for (int j = old_count - 1; j >= 0; j--) {
+      EditorRow *row = &config.rows[prefix + j];
+      hashes[j] = hashBytes(row->chars, row->size);
+      int bucket = hashes[j] & (buckets - 1);
+      next[j] = heads[bucket];
+      heads[bucket] = j;
+      moved_to[j] = -1;
+    }
+
+    EditorRow *rows = malloc(sizeof(EditorRow) * (new_count + 1));
+    int last_reused = -1;
+    for (int k = 0; k < new_count; k++) {
+      struct DiskLine *line = &lines[prefix + k];
+      line->hash = hashBytes(line->start, line->length);
+      int bucket = line->hash & (buckets - 1);
+
+      // reuse rows in order; anything before the last reuse is gone for good
+      while (heads[bucket] != -1 && heads[bucket] <= last_reused) {
+        heads[bucket] = next[heads[bucket]];
+      }
+      int match = heads[bucket];
+      while (match != -1 &&
+             (hashes[match] != line->hash ||
+              !editorRowMatchesLine(&config.rows[prefix + match], line))) {
+        match = next[match];
+      }
+
+      if (match != -1) {
+        rows[k] = config.rows[prefix + match];
+        moved_to[match] = prefix + k;
+        last_reused = match;
+      } else {
+        editorInitRow(&rows[k], line->start, line->length);
+        read_count++;
+      }
+    }
+
+    for (int j = 0; j < old_count; j++) {
+      if (moved_to[j] == -1) {
+        editorFreeRow(&config.rows[prefix + j]);
+      }
+    }
+    editorSpliceRows(prefix, old_count, rows, new_count);
+
+    // keep the cursor and viewport on the same text where possible
+    int old_end = prefix + old_count;
+    int delta = new_count - old_count;
+    editorReloadMoveCursor(&config.cy, prefix, old_end, delta, moved_to);
+    editorReloadMoveCursor(&config.row_offset, prefix, old_end, delta,
+                           moved_to);
+
+    free(rows);
+    free(moved_to);
+    free(hashes);
+    free(next);
+    free(heads);
+  }
+
+  // every row is now a line of the file as it is on disk
+  editorSaveBeginVersion();
+  for (int j = 0; j < line_count; j++) {
+    char *end = lines[j].start + lines[j].length;
+    editorSaveRowRead(&config.rows[j], lines[j].start - data,
+                      end < data + st.st_size && *end == '\n');
+  }
+
+  free(lines);
+  free(data);
+  close(fd);
+
+  if (config.cy > config.row_count) {
+    config.cy = config.row_count;
+  }
+  int row_length = config.cy < config.row_count ? config.rows[config.cy].size : 0;
+  if (config.cx > row_length) {
+    config.cx = row_length;
+  }
+
+  // the rows now match the file, not the edits that were recorded
+  editorUndoClear();
+  config.dirty = 0;
+  editorRecordFileStamp();
+  return read_count;
+}
+
+int editorCheckFileChange(void) {
+  static _Thread_local time_t last_check = 0;
+  time_t now = time(NULL);
+  if (now - last_check < KILO_RELOAD_CHECK_INTERVAL) {
+    return 0;
+  }
+  last_check = now;
+
+  if (config.follow_fd != -1 || !editorFileChangedOnDisk()) {
+    return 0;
+  }
+
+  if (config.dirty) {
+    if (!config.file_change_warned) {
+      config.file_change_warned = 1;
+      editorSetStatusMessage("WARNING! File changed on disk. Ctrl-R to reload "
+                             "and discard your changes.");
+      return 1;
+    }
+    return 0;
+  }
+
+  int read_count = editorReloadChanged();
+  if (read_count == -1) {
+    return 0;
+  }
+  editorSetStatusMessage("File changed on disk; reloaded %d line%s.",
+                         read_count, read_count == 1 ? "" : "s");
+  return 1;
+}
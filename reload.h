@@ -0,0 +1,28 @@
+#ifndef reload_h
+#define reload_h
+
+#include "editor.h"
+
+// Detecting changes made to the open file by other programs, and reloading
+// only the rows that actually changed.
+
+// Read the identity and version of `path` into `stamp`. Returns -1 on error.
+int editorStatFile(char *path, struct FileStamp *stamp);
+
+// Remember the on-disk version of the current file as the one we have loaded.
+void editorRecordFileStamp(void);
+
+// Returns 1 if the current file has been modified on disk since we last read
+// or wrote it.
+int editorFileChangedOnDisk(void);
+
+// Bring the rows up to date with the file on disk, replacing only the rows
+// that differ. Local edits are discarded. Returns the number of rows that had
+// to be read from disk, or -1 on error.
+int editorReloadChanged(void);
+
+// Called while idle: reloads a clean buffer whose file changed on disk, or
+// warns about a modified one. Returns 1 if the screen should be redrawn.
+int editorCheckFileChange(void);
+
+#endif
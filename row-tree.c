@@ -0,0 +1,221 @@
+#include "row-tree.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void editorRowTreeInit(struct RowTree *tree, size_t summary_size,
+                       void (*summarize)(void *summary, int row),
+                       void (*combine)(void *into, const void *next)) {
+  tree->nodes = NULL;
+  tree->capacity = 0;
+  tree->used = 0;
+  tree->free_list = 0;
+  tree->root = 0;
+  tree->made = 0;
+  tree->summaries = NULL;
+  tree->summary_size = summary_size;
+  tree->summarize = summarize;
+  tree->combine = combine;
+}
+
+void editorRowTreeFree(struct RowTree *tree) {
+  free(tree->nodes);
+  free(tree->summaries);
+  editorRowTreeInit(tree, tree->summary_size, tree->summarize, tree->combine);
+}
+
+int editorRowTreeBuilt(struct RowTree *tree) { return tree->nodes != NULL; }
+
+void *editorRowTreeRowSummary(struct RowTree *tree, int node) {
+  return &tree->summaries[tree->summary_size * 2 * node];
+}
+
+void *editorRowTreeSummary(struct RowTree *tree, int node) {
+  return &tree->summaries[tree->summary_size * (2 * node + 1)];
+}
+
+#pragma mark - Nodes
+
+// A new node's place in the heap order. The hash is a bijection, so no two
+// nodes tie. It's drawn afresh rather than kept with a recycled node, whose
+// old priority would follow the shape of the rows it was freed from.
+uint32_t editorRowTreePriority(uint32_t made) {
+  uint32_t x = made;
+  x ^= x >> 16;
+  x *= 0x7feb352dU;
+  x ^= x >> 15;
+  x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
+
+void editorRowTreeReserve(struct RowTree *tree, int capacity) {
+  if (capacity <= tree->capacity) {
+    return;
+  }
+  tree->capacity = capacity;
+  tree->nodes = realloc(tree->nodes, sizeof(struct RowTreeNode) * capacity);
+  tree->summaries =
+      realloc(tree->summaries, tree->summary_size * 2 * (size_t)capacity);
+}
+
+// forget every node but the empty tree
+void editorRowTreeReset(struct RowTree *tree, int capacity) {
+  editorRowTreeReserve(tree, capacity < 16 ? 16 : capacity);
+  tree->nodes[0].left = tree->nodes[0].right = tree->nodes[0].size = 0;
+  tree->nodes[0].priority = 0;
+  memset(tree->summaries, 0, tree->summary_size * 2);
+  tree->used = 1;
+  tree->free_list = 0;
+  tree->root = 0;
+}
+
+int editorRowTreeAllocate(struct RowTree *tree) {
+  int node;
+  if (tree->free_list) {
+    node = tree->free_list;
+    tree->free_list = tree->nodes[node].left;
+  } else {
+    if (tree->used == tree->capacity) {
+      editorRowTreeReserve(tree, tree->capacity * 2);
+    }
+    node = tree->used++;
+  }
+  tree->nodes[node].priority = editorRowTreePriority(++tree->made);
+  return node;
+}
+
+// give a subtree's nodes back
+void editorRowTreeRelease(struct RowTree *tree, int node) {
+  if (node == 0) {
+    return;
+  }
+  editorRowTreeRelease(tree, tree->nodes[node].left);
+  editorRowTreeRelease(tree, tree->nodes[node].right);
+  tree->nodes[node].left = tree->free_list;
+  tree->free_list = node;
+}
+
+// recompute `node`'s size and subtree summary from its children's
+void editorRowTreePull(struct RowTree *tree, int node) {
+  struct RowTreeNode *n = &tree->nodes[node];
+  n->size = tree->nodes[n->left].size + 1 + tree->nodes[n->right].size;
+  void *summary = editorRowTreeSummary(tree, node);
+  memcpy(summary, editorRowTreeSummary(tree, n->left), tree->summary_size);
+  tree->combine(summary, editorRowTreeRowSummary(tree, node));
+  tree->combine(summary, editorRowTreeSummary(tree, n->right));
+}
+
+#pragma mark - Shape
+
+// Make a tree of new nodes for rows [first, first + count), returning its
+// root. The nodes arrive in row order, so each goes on the right spine of the
+// tree so far, above any lower priority nodes there, which become its left
+// subtree; that's O(count) overall.
+int editorRowTreeBuildRange(struct RowTree *tree, int first, int count) {
+  if (count == 0) {
+    return 0;
+  }
+  int *spine = malloc(sizeof(int) * count);
+  int depth = 0;
+  for (int j = 0; j < count; j++) {
+    int node = editorRowTreeAllocate(tree);
+    tree->summarize(editorRowTreeRowSummary(tree, node), first + j);
+    uint32_t priority = tree->nodes[node].priority;
+
+    int below = 0;
+    while (depth > 0 && tree->nodes[spine[depth - 1]].priority < priority) {
+      below = spine[--depth];
+      // its right subtree is finished: it was popped just before
+      editorRowTreePull(tree, below);
+    }
+    tree->nodes[node].left = below;
+    tree->nodes[node].right = 0;
+    if (depth > 0) {
+      tree->nodes[spine[depth - 1]].right = node;
+    }
+    spine[depth++] = node;
+  }
+
+  // the bottom of the spine is the root; count > 0, so there is one
+  int root = depth > 0 ? spine[0] : 0;
+  while (depth > 0) {
+    editorRowTreePull(tree, spine[--depth]);
+  }
+  free(spine);
+  return root;
+}
+
+// split the subtree at `node` into its first `count` rows and the rest
+void editorRowTreeSplit(struct RowTree *tree, int node, int count, int *first,
+                        int *rest) {
+  if (node == 0) {
+    *first = *rest = 0;
+    return;
+  }
+  struct RowTreeNode *n = &tree->nodes[node];
+  int left_size = tree->nodes[n->left].size;
+  if (count <= left_size) {
+    editorRowTreeSplit(tree, n->left, count, first, &n->left);
+    *rest = node;
+  } else {
+    editorRowTreeSplit(tree, n->right, count - left_size - 1, &n->right, rest);
+    *first = node;
+  }
+  editorRowTreePull(tree, node);
+}
+
+// join two subtrees, `a`'s rows first
+int editorRowTreeMerge(struct RowTree *tree, int a, int b) {
+  if (a == 0 || b == 0) {
+    return a ? a : b;
+  }
+  if (tree->nodes[a].priority > tree->nodes[b].priority) {
+    tree->nodes[a].right = editorRowTreeMerge(tree, tree->nodes[a].right, b);
+    editorRowTreePull(tree, a);
+    return a;
+  }
+  tree->nodes[b].left = editorRowTreeMerge(tree, a, tree->nodes[b].left);
+  editorRowTreePull(tree, b);
+  return b;
+}
+
+#pragma mark - Rows
+
+void editorRowTreeBuild(struct RowTree *tree, int count) {
+  editorRowTreeReset(tree, count + 1);
+  tree->root = editorRowTreeBuildRange(tree, 0, count);
+}
+
+void editorRowTreeSplice(struct RowTree *tree, int at, int remove_count,
+                         int add_count) {
+  int before, rest, removed, after;
+  editorRowTreeSplit(tree, tree->root, at, &before, &rest);
+  editorRowTreeSplit(tree, rest, remove_count, &removed, &after);
+  editorRowTreeRelease(tree, removed);
+  int added = editorRowTreeBuildRange(tree, at, add_count);
+  tree->root = editorRowTreeMerge(
+      tree, editorRowTreeMerge(tree, before, added), after);
+}
+
+// summarize row `row`, which is the `index`th row of the subtree at `node`
+void editorRowTreeUpdateNode(struct RowTree *tree, int node, int index,
+                             int row) {
+  int left = tree->nodes[node].left;
+  int left_size = tree->nodes[left].size;
+  if (index < left_size) {
+    editorRowTreeUpdateNode(tree, left, index, row);
+  } else if (index > left_size) {
+    editorRowTreeUpdateNode(tree, tree->nodes[node].right,
+                            index - left_size - 1, row);
+  } else {
+    tree->summarize(editorRowTreeRowSummary(tree, node), row);
+  }
+  editorRowTreePull(tree, node);
+}
+
+void editorRowTreeUpdate(struct RowTree *tree, int row) {
+  if (row >= 0 && row < tree->nodes[tree->root].size) {
+    editorRowTreeUpdateNode(tree, tree->root, row, row);
+  }
+}
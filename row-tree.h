@@ -0,0 +1,64 @@
+#ifndef row_tree_h
+#define row_tree_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A balanced tree with one node per row, in row order, where each node keeps a
+// summary of its row and a summary of its whole subtree (say, how many screen
+// lines the rows wrap to). Finding a row by what comes before it is a walk
+// down the tree; changing a row patches the summaries on its path; and
+// inserting or removing a run of rows splits the tree around it and joins the
+// pieces back up, all in O(log n) (plus the rows added or removed). The tree
+// is a treap whose priorities are hashes of a count of nodes made.
+//
+// Summaries are `summary_size` bytes, combined by `combine`; all zero bytes
+// must mean "no rows".
+
+struct RowTreeNode {
+  int left, right;
+  // how many rows the subtree holds
+  int size;
+  uint32_t priority;
+};
+
+struct RowTree {
+  // node 0 is the empty tree; freed nodes are chained through `left`
+  struct RowTreeNode *nodes;
+  int capacity;
+  int used;
+  int free_list;
+  int root;
+  // nodes made so far, which seeds the next one's priority
+  uint32_t made;
+  // for each node, the summary of its row then that of its subtree
+  char *summaries;
+  size_t summary_size;
+  // fill in the summary of row `row`
+  void (*summarize)(void *summary, int row);
+  // make `into` the summary of its rows followed by `next`'s
+  void (*combine)(void *into, const void *next);
+};
+
+void editorRowTreeInit(struct RowTree *tree, size_t summary_size,
+                       void (*summarize)(void *summary, int row),
+                       void (*combine)(void *into, const void *next));
+// Free the nodes; the tree is empty until it's next built.
+void editorRowTreeFree(struct RowTree *tree);
+// whether the tree has been built since it was last freed
+int editorRowTreeBuilt(struct RowTree *tree);
+
+// Build the tree over rows [0, count), in O(count).
+void editorRowTreeBuild(struct RowTree *tree, int count);
+// Rows [at, at + remove_count) were replaced with `add_count` rows, which are
+// now in place and are summarized afresh.
+void editorRowTreeSplice(struct RowTree *tree, int at, int remove_count,
+                         int add_count);
+// Row `row` changed; summarize it again.
+void editorRowTreeUpdate(struct RowTree *tree, int row);
+
+// the summaries of `node`'s own row and of its whole subtree
+void *editorRowTreeRowSummary(struct RowTree *tree, int node);
+void *editorRowTreeSummary(struct RowTree *tree, int node);
+
+#endif
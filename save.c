@@ -0,0 +1,340 @@
+#include "save.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+// edited rows are gathered into writes of up to this many bytes
+#define KILO_SAVE_CHUNK (1 << 20)
+// shorter runs of unchanged rows are written from memory like edited ones,
+// rather than spending a system call on each (e.g. after sorting)
+#define KILO_SAVE_MIN_COPY (16 * 1024)
+
+// how unchanged rows are copied; each method falls back to the next when the
+// kernel or filesystem can't do it
+enum SaveMethod { SAVE_COPY_RANGE, SAVE_SENDFILE, SAVE_READ_WRITE };
+
+struct SaveWriter {
+  int fd;
+  // the old file, or -1 when nothing can be copied from it
+  int source_fd;
+  enum SaveMethod method;
+  // edited rows waiting to be written
+  char *pending;
+  size_t pending_length;
+  long long copied;
+};
+
+// numbers every version of every file read or written, so that a row is only
+// ever copied from the file it was read from, even after moving between
+// buffers through the clipboard
+_Thread_local unsigned file_versions = 0;
+
+void editorSaveBeginVersion(void) { config.file_version = ++file_versions; }
+
+void editorSaveRowRead(EditorRow *row, off_t offset, int newline) {
+  row->file_offset = newline ? offset : -1;
+  row->file_version = config.file_version;
+}
+
+int editorSaveRowOnDisk(EditorRow *row) {
+  return row->file_offset != -1 && row->file_version == config.file_version;
+}
+
+#pragma mark - Writing
+
+int editorSaveWriteAll(int fd, char *data, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd, data, length);
+    if (written == -1 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return -1;
+    }
+    data += written;
+    length -= written;
+  }
+  return 0;
+}
+
+int editorSaveFlush(struct SaveWriter *writer) {
+  int result =
+      editorSaveWriteAll(writer->fd, writer->pending, writer->pending_length);
+  writer->pending_length = 0;
+  return result;
+}
+
+int editorSaveAppend(struct SaveWriter *writer, char *data, size_t length) {
+  if (writer->pending_length + length > KILO_SAVE_CHUNK &&
+      editorSaveFlush(writer) == -1) {
+    return -1;
+  }
+  if (length > KILO_SAVE_CHUNK) {
+    return editorSaveWriteAll(writer->fd, data, length);
+  }
+  memcpy(&writer->pending[writer->pending_length], data, length);
+  writer->pending_length += length;
+  return 0;
+}
+
+// copy bytes [offset, offset + length) of the old file to the end of the new
+int editorSaveCopy(struct SaveWriter *writer, off_t offset, long long length) {
+  // what's pending comes first
+  if (editorSaveFlush(writer) == -1) {
+    return -1;
+  }
+
+  while (length > 0) {
+    size_t chunk = length < KILO_SAVE_CHUNK ? (size_t)length : KILO_SAVE_CHUNK;
+    ssize_t copied = -1;
+#if defined(__linux__) && defined(SYS_copy_file_range)
+    if (writer->method == SAVE_COPY_RANGE) {
+      // called directly, since glibc only declares it for _GNU_SOURCE
+      long long source_offset = offset;
+      copied = syscall(SYS_copy_file_range, writer->source_fd, &source_offset,
+                       writer->fd, NULL, chunk, 0);
+      if (copied == -1 && (errno == ENOSYS || errno == EXDEV ||
+                           errno == EINVAL || errno == EOPNOTSUPP)) {
+        writer->method = SAVE_SENDFILE;
+        continue;
+      }
+    }
+#endif
+#ifdef __linux__
+    if (writer->method == SAVE_SENDFILE) {
+      off_t source_offset = offset;
+      copied = sendfile(writer->fd, writer->source_fd, &source_offset, chunk);
+      if (copied == -1 && (errno == ENOSYS || errno == EINVAL)) {
+        writer->method = SAVE_READ_WRITE;
+        continue;
+      }
+    }
+#endif
+    if (writer->method == SAVE_READ_WRITE) {
+      // nothing is pending, so its buffer is free
+      copied = pread(writer->source_fd, writer->pending, chunk, offset);
+      if (copied > 0 &&
+          editorSaveWriteAll(writer->fd, writer->pending, copied) == -1) {
+        return -1;
+      }
+    }
+
+    if (copied == -1 && errno == EINTR) {
+      continue;
+    }
+    if (copied <= 0) {
+      // the old file got shorter underneath us
+      if (copied == 0) {
+        errno = EIO;
+      }
+      return -1;
+    }
+    offset += copied;
+    length -= copied;
+    writer->copied += copied;
+  }
+  return 0;
+}
+
+// write every row, copying runs of unchanged ones from the old file
+int editorSaveWriteRows(struct SaveWriter *writer) {
+  int j = 0;
+  while (j < config.row_count) {
+    // the run of rows that follow each other in the old file
+    int first = j;
+    off_t start = config.rows[j].file_offset;
+    off_t end = start;
+    if (writer->source_fd != -1) {
+      while (j < config.row_count && editorSaveRowOnDisk(&config.rows[j]) &&
+             config.rows[j].file_offset == end) {
+        end += config.rows[j].size + 1;
+        j++;
+      }
+    }
+
+    if (end - start >= KILO_SAVE_MIN_COPY) {
+      if (editorSaveCopy(writer, start, end - start) == -1) {
+        return -1;
+      }
+      continue;
+    }
+    // an edited row, or too short a run to be worth copying
+    if (j == first) {
+      j++;
+    }
+    for (int k = first; k < j; k++) {
+      EditorRow *row = &config.rows[k];
+      if (editorSaveAppend(writer, row->chars, row->size) == -1 ||
+          editorSaveAppend(writer, "\n", 1) == -1) {
+        return -1;
+      }
+    }
+  }
+  return editorSaveFlush(writer);
+}
+
+#pragma mark - Saving
+
+// Open the file the rows were read from, if any of them can be copied from
+// it. Returns -1 otherwise.
+int editorSaveOpenSource(struct stat *st) {
+  int j = 0;
+  while (j < config.row_count && !editorSaveRowOnDisk(&config.rows[j])) {
+    j++;
+  }
+  if (j == config.row_count) {
+    return -1;
+  }
+
+  // a link, or a file with other names, is written in place so that it stays
+  // one; replacing it would split it off
+  struct stat link;
+  if (lstat(config.filename, &link) == -1 || !S_ISREG(link.st_mode) ||
+      link.st_nlink != 1) {
+    return -1;
+  }
+
+  // the offsets are only good for the version of the file they came from
+  int fd = open(config.filename, O_RDONLY);
+  if (fd == -1) {
+    return -1;
+  }
+  if (fstat(fd, st) == -1 || st->st_dev != config.file_stamp.device ||
+      st->st_ino != config.file_stamp.inode ||
+      st->st_size != config.file_stamp.size ||
+      st->st_mtime != config.file_stamp.mtime_sec ||
+      KILO_MTIME_NSEC(*st) != config.file_stamp.mtime_nsec) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Make a rename in the directory holding `path` durable. The rename has
+// happened either way, and some filesystems can't sync a directory, so errors
+// are ignored.
+void editorSaveSyncDirectory(char *path) {
+  char directory[4096];
+  char *slash = strrchr(path, '/');
+  if (slash == NULL) {
+    strcpy(directory, ".");
+  } else if (slash == path) {
+    strcpy(directory, "/");
+  } else if (snprintf(directory, sizeof(directory), "%.*s", (int)(slash - path),
+                      path) >= (int)sizeof(directory)) {
+    return;
+  }
+
+  int fd = open(directory, O_RDONLY);
+  if (fd != -1) {
+    fsync(fd);
+    close(fd);
+  }
+}
+
+long long editorSaveWrite(long long *copied, int *mode_error) {
+  long long length = 0;
+  for (int j = 0; j < config.row_count; j++) {
+    length += config.rows[j].size + 1;
+  }
+
+  struct SaveWriter writer;
+  writer.source_fd = -1;
+#if defined(__linux__) && defined(SYS_copy_file_range)
+  writer.method = SAVE_COPY_RANGE;
+#elif defined(__linux__)
+  writer.method = SAVE_SENDFILE;
+#else
+  writer.method = SAVE_READ_WRITE;
+#endif
+  writer.pending = NULL;
+  writer.pending_length = 0;
+  writer.copied = 0;
+  *mode_error = 0;
+
+  // copying needs the old file intact until the end, so the new one is
+  // written alongside it
+  struct stat st;
+  char temp_path[4096];
+  writer.fd = -1;
+  int source_fd = editorSaveOpenSource(&st);
+  if (source_fd != -1 &&
+      snprintf(temp_path, sizeof(temp_path), "%s.kilo-XXXXXX",
+               config.filename) < (int)sizeof(temp_path) &&
+      (writer.fd = mkstemp(temp_path)) != -1) {
+    writer.source_fd = source_fd;
+    // the new file starts out private to us; if it can't be given the old
+    // one's permissions, the save goes ahead and the caller says so
+    if (fchmod(writer.fd, st.st_mode & 07777) == -1) {
+      *mode_error = errno;
+    }
+    if (fchown(writer.fd, st.st_uid, st.st_gid) == -1) {
+      // only root can give a file away; it stays ours
+    }
+  } else {
+    if (source_fd != -1) {
+      close(source_fd);
+    }
+    //  0644 -> owner has read/write, others can read
+    writer.fd = open(config.filename, O_RDWR | O_CREAT, 0644);
+    if (writer.fd == -1) {
+      return -1;
+    }
+    if (ftruncate(writer.fd, length) == -1) {
+      int error = errno;
+      close(writer.fd);
+      errno = error;
+      return -1;
+    }
+  }
+
+  writer.pending = malloc(KILO_SAVE_CHUNK);
+  int result = editorSaveWriteRows(&writer);
+  // the new file's contents must reach the disk before the rename does, or a
+  // crash could leave the name pointing at an empty file
+  if (result == 0 && writer.source_fd != -1) {
+    result = fsync(writer.fd);
+  }
+  int error = errno;
+  free(writer.pending);
+  if (close(writer.fd) == -1 && result == 0) {
+    result = -1;
+    error = errno;
+  }
+  if (writer.source_fd != -1) {
+    close(writer.source_fd);
+    if (result == 0 && rename(temp_path, config.filename) == -1) {
+      result = -1;
+      error = errno;
+    }
+    if (result == -1) {
+      unlink(temp_path);
+    } else {
+      editorSaveSyncDirectory(config.filename);
+    }
+  }
+  if (result == -1) {
+    errno = error;
+    return -1;
+  }
+
+  // the rows now describe the new file exactly
+  editorSaveBeginVersion();
+  off_t offset = 0;
+  for (int j = 0; j < config.row_count; j++) {
+    editorSaveRowRead(&config.rows[j], offset, 1);
+    offset += config.rows[j].size + 1;
+  }
+  *copied = writer.copied;
+  return length;
+}
@@ -0,0 +1,28 @@
+#ifndef save_h
+#define save_h
+
+#include "editor.h"
+
+// Saving without rewriting what wasn't edited. Every row read from the file
+// remembers where it came from; on save, runs of rows that haven't changed are
+// copied from the old file into the new one, inside the kernel on Linux
+// (copy_file_range, which can share blocks on filesystems with reflinks, or
+// else sendfile), and only edited rows are written from memory. The new file
+// is written next to the old one, synced to disk, and renamed over it.
+
+// Start a new version of the current document's file, e.g. before reading it
+// in; rows read from older versions are no longer copied.
+void editorSaveBeginVersion(void);
+
+// Record that `row` was read from `offset` in the current version of the
+// file. `newline` says whether a lone \n followed it there, which is what
+// saving writes after every row; rows that ended otherwise aren't copied.
+void editorSaveRowRead(EditorRow *row, off_t offset, int newline);
+
+// Write the document to its file. Returns the number of bytes in the file, or
+// -1 (with errno set) on error. `*copied` is set to how many of them were
+// copied from the old file, and `*mode_error` to the errno from failing to give
+// a replacement file the old one's permissions, or 0.
+long long editorSaveWrite(long long *copied, int *mode_error);
+
+#endif
@@ -0,0 +1,484 @@
+#include "script.h"
+#include "clipboard.h"
+#include "editor.h"
+#include "trace.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the window a script's keystrokes see, as if on an 80x24 terminal
+#define KILO_SCRIPT_ROWS 22
+#define KILO_SCRIPT_COLS 80
+
+enum ScriptOp {
+  SCRIPT_GOTO,
+  SCRIPT_INSERT,
+  SCRIPT_BACKSPACE,
+  SCRIPT_KEYS,
+  SCRIPT_SAVE
+};
+
+struct ScriptCommand {
+  enum ScriptOp op;
+  // goto: the line and column; backspace: the count
+  int line;
+  int column;
+  // insert and keys: the bytes to type, escapes decoded
+  char *text;
+  int length;
+};
+
+struct Script {
+  struct ScriptCommand *commands;
+  int count;
+  int capacity;
+};
+
+// the files still to be edited, shared by the workers
+struct ScriptQueue {
+  struct Script *script;
+  char **files;
+  int file_count;
+  int next_file;
+  int failures;
+  // guards next_file, failures and stdout
+  pthread_mutex_t lock;
+};
+
+struct ScriptKey {
+  const char *name;
+  const char *bytes;
+};
+
+struct ScriptKey script_keys[] = {
+    {"up", "\x1b[A"},         {"down", "\x1b[B"},
+    {"right", "\x1b[C"},      {"left", "\x1b[D"},
+    {"home", "\x1b[H"},       {"end", "\x1b[F"},
+    {"pageup", "\x1b[5~"},    {"pagedown", "\x1b[6~"},
+    {"delete", "\x1b[3~"},    {"backspace", "\x7f"},
+    {"enter", "\r"},
+};
+
+#pragma mark - Parsing
+
+// decode the escapes in `text` in place; returns the decoded length
+int editorScriptUnescape(char *text) {
+  char *out = text;
+  for (char *p = text; *p; p++) {
+    if (*p != '\\' || p[1] == '\0') {
+      *out++ = *p;
+      continue;
+    }
+    p++;
+    switch (*p) {
+    case 'n':
+      *out++ = '\n';
+      break;
+    case 'r':
+      *out++ = '\r';
+      break;
+    case 't':
+      *out++ = '\t';
+      break;
+    case 'e':
+      *out++ = '\x1b';
+      break;
+    case 'x':
+      if (isxdigit((unsigned char)p[1]) && isxdigit((unsigned char)p[2])) {
+        char hex[3] = {p[1], p[2], '\0'};
+        *out++ = (char)strtol(hex, NULL, 16);
+        p += 2;
+        break;
+      }
+      *out++ = *p;
+      break;
+    default:
+      *out++ = *p;
+    }
+  }
+  return (int)(out - text);
+}
+
+// turn `key NAME [N]` into the bytes a terminal would send; returns -1 for an
+// unknown key
+int editorScriptKeyBytes(char *argument, struct ScriptCommand *command) {
+  char name[32];
+  int repeat = 1;
+  if (sscanf(argument, "%31s %d", name, &repeat) < 1 || repeat < 1) {
+    return -1;
+  }
+
+  char ctrl[2] = {0, 0};
+  const char *bytes = NULL;
+  if (strncmp(name, "ctrl-", 5) == 0 && isalpha((unsigned char)name[5]) &&
+      name[6] == '\0') {
+    ctrl[0] = (char)(tolower((unsigned char)name[5]) & 0x1f);
+    bytes = ctrl;
+  }
+  for (size_t j = 0; !bytes && j < sizeof(script_keys) / sizeof(script_keys[0]);
+       j++) {
+    if (strcmp(name, script_keys[j].name) == 0) {
+      bytes = script_keys[j].bytes;
+    }
+  }
+  if (!bytes) {
+    return -1;
+  }
+
+  int length = (int)strlen(bytes);
+  command->text = malloc(length * repeat + 1);
+  for (int j = 0; j < repeat; j++) {
+    memcpy(&command->text[j * length], bytes, length);
+  }
+  command->length = length * repeat;
+  return 0;
+}
+
+int editorScriptParseLine(char *line, struct ScriptCommand *command) {
+  char *argument = strchr(line, ' ');
+  if (argument) {
+    *argument++ = '\0';
+  } else {
+    argument = "";
+  }
+
+  command->text = NULL;
+  command->length = 0;
+  command->line = 0;
+  command->column = 1;
+
+  if (strcmp(line, "goto") == 0) {
+    command->op = SCRIPT_GOTO;
+    return sscanf(argument, "%d %d", &command->line, &command->column) >= 1
+               ? 0
+               : -1;
+  }
+  if (strcmp(line, "insert") == 0 || strcmp(line, "keys") == 0) {
+    command->op = line[0] == 'i' ? SCRIPT_INSERT : SCRIPT_KEYS;
+    command->text = strdup(argument);
+    command->length = editorScriptUnescape(command->text);
+    return 0;
+  }
+  if (strcmp(line, "backspace") == 0) {
+    command->op = SCRIPT_BACKSPACE;
+    command->line = 1;
+    return *argument == '\0' || sscanf(argument, "%d", &command->line) == 1
+               ? 0
+               : -1;
+  }
+  if (strcmp(line, "key") == 0) {
+    command->op = SCRIPT_KEYS;
+    return editorScriptKeyBytes(argument, command);
+  }
+  if (strcmp(line, "save") == 0) {
+    command->op = SCRIPT_SAVE;
+    return 0;
+  }
+  return -1;
+}
+
+void editorScriptFree(struct Script *script) {
+  for (int j = 0; j < script->count; j++) {
+    free(script->commands[j].text);
+  }
+  free(script->commands);
+}
+
+int editorScriptLoad(char *path, struct Script *script) {
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  script->commands = NULL;
+  script->count = 0;
+  script->capacity = 0;
+
+  char *line = NULL;
+  size_t linecap = 0;
+  ssize_t line_length;
+  int line_number = 0;
+  int result = 0;
+
+  while ((line_length = getline(&line, &linecap, fp)) != -1) {
+    line_number++;
+    while (line_length > 0 &&
+           (line[line_length - 1] == '\n' || line[line_length - 1] == '\r')) {
+      line[--line_length] = '\0';
+    }
+    if (line_length == 0 || line[0] == '#') {
+      continue;
+    }
+
+    if (script->count == script->capacity) {
+      script->capacity = script->capacity ? script->capacity * 2 : 16;
+      script->commands = realloc(
+          script->commands, sizeof(struct ScriptCommand) * script->capacity);
+    }
+    if (editorScriptParseLine(line, &script->commands[script->count]) == -1) {
+      fprintf(stderr, "%s:%d: bad command: %s\n", path, line_number, line);
+      free(script->commands[script->count].text);
+      result = -1;
+      break;
+    }
+    script->count++;
+  }
+
+  free(line);
+  fclose(fp);
+  if (result == -1) {
+    editorScriptFree(script);
+  }
+  return result;
+}
+
+#pragma mark - Editing
+
+void editorScriptGoto(int line, int column) {
+  config.cy = line - 1;
+  if (config.cy < 0) {
+    config.cy = 0;
+  } else if (config.cy > config.row_count) {
+    config.cy = config.row_count;
+  }
+
+  int size = config.cy < config.row_count ? config.rows[config.cy].size : 0;
+  config.cx = column - 1;
+  if (config.cx < 0) {
+    config.cx = 0;
+  } else if (config.cx > size) {
+    config.cx = size;
+  }
+}
+
+void editorScriptInsert(const char *text, int length) {
+  for (int j = 0; j < length; j++) {
+    if (text[j] == '\n') {
+      editorInsertNewline();
+    } else {
+      editorInsertChar(text[j]);
+    }
+  }
+}
+
+// Buffers belong to the interactive editor on the main thread, so a script
+// can't press the keys that open or switch them. Any such byte counts, even one
+// that would only have been typed into a prompt.
+int editorScriptUsesBuffers(struct Script *script) {
+  for (int j = 0; j < script->count; j++) {
+    struct ScriptCommand *command = &script->commands[j];
+    if (command->op == SCRIPT_KEYS &&
+        (memchr(command->text, 'o' & 0x1f, command->length) ||
+         memchr(command->text, 'b' & 0x1f, command->length))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Apply the script to the file at `path` in this thread's editor. Returns -1
+// and describes the problem in `error` if the file couldn't be edited.
+int editorScriptApply(struct Script *script, char *path, char *error,
+                      size_t error_size, int *saved) {
+  editorInit();
+  config.headless = 1;
+  config.wsize.ws_row = KILO_SCRIPT_ROWS;
+  config.wsize.ws_col = KILO_SCRIPT_COLS;
+
+  int result = 0;
+  *saved = 0;
+  if (editorScriptUsesBuffers(script)) {
+    snprintf(error, error_size, "ctrl-o and ctrl-b can't be used in a script");
+    editorClose();
+    return -1;
+  }
+  // opening an unreadable file is fatal for an interactive editor, but here
+  // it only fails this file
+  if (editorOpenFile(path) == -1) {
+    snprintf(error, error_size, "%s", strerror(errno));
+    editorClose();
+    return -1;
+  }
+
+  for (int j = 0; j < script->count; j++) {
+    struct ScriptCommand *command = &script->commands[j];
+    switch (command->op) {
+    case SCRIPT_GOTO:
+      editorScriptGoto(command->line, command->column);
+      break;
+    case SCRIPT_INSERT:
+      editorScriptInsert(command->text, command->length);
+      break;
+    case SCRIPT_BACKSPACE:
+      for (int k = 0; k < command->line; k++) {
+        editorDeleteChar();
+      }
+      break;
+    case SCRIPT_KEYS:
+      // the keystrokes quit the editor; skip the rest of the script
+      if (!editorTraceFeed(command->text, command->length)) {
+        j = script->count;
+      }
+      break;
+    case SCRIPT_SAVE:
+      if (editorSave() == -1) {
+        snprintf(error, error_size, "%s", config.status_message);
+        result = -1;
+        j = script->count;
+      } else {
+        *saved = 1;
+      }
+      break;
+    }
+  }
+
+  editorClose();
+  // the next file starts with nothing copied; this also lets go of any rows
+  // it shares with this file
+  editorClipboardClear();
+  return result;
+}
+
+void *editorScriptWorker(void *argument) {
+  struct ScriptQueue *queue = argument;
+
+  for (;;) {
+    pthread_mutex_lock(&queue->lock);
+    int index = queue->next_file++;
+    pthread_mutex_unlock(&queue->lock);
+    if (index >= queue->file_count) {
+      return NULL;
+    }
+
+    char *path = queue->files[index];
+    char error[128];
+    int saved;
+    int result =
+        editorScriptApply(queue->script, path, error, sizeof(error), &saved);
+
+    pthread_mutex_lock(&queue->lock);
+    if (result == -1) {
+      queue->failures++;
+      printf("%s: error: %s\n", path, error);
+    } else {
+      printf("%s: ok%s\n", path, saved ? ", saved" : "");
+    }
+    pthread_mutex_unlock(&queue->lock);
+  }
+}
+
+struct ScriptFile {
+  dev_t device;
+  ino_t inode;
+  int index;
+};
+
+int editorScriptCompareFiles(const void *a, const void *b) {
+  const struct ScriptFile *x = a, *y = b;
+  if (x->device != y->device) {
+    return x->device < y->device ? -1 : 1;
+  }
+  if (x->inode != y->inode) {
+    return x->inode < y->inode ? -1 : 1;
+  }
+  return x->index - y->index;
+}
+
+// Fail every file named after another name for the same file (repeated, or
+// through a link), so that no two workers ever write one file. The rest are
+// put in `unique`, in order; returns how many there are.
+int editorScriptUniqueFiles(char **files, int file_count, char **unique) {
+  struct ScriptFile *found = malloc(sizeof(struct ScriptFile) * file_count);
+  char *repeated = calloc(file_count, 1);
+  int found_count = 0;
+  for (int j = 0; j < file_count; j++) {
+    struct stat st;
+    // a file that can't be found fails when it's opened
+    if (stat(files[j], &st) == 0) {
+      found[found_count].device = st.st_dev;
+      found[found_count].inode = st.st_ino;
+      found[found_count].index = j;
+      found_count++;
+    }
+  }
+
+  // each file's names end up together, the first one given leading
+  qsort(found, found_count, sizeof(struct ScriptFile),
+        editorScriptCompareFiles);
+  int first = 0;
+  for (int j = 1; j < found_count; j++) {
+    if (found[j].device != found[first].device ||
+        found[j].inode != found[first].inode) {
+      first = j;
+      continue;
+    }
+    repeated[found[j].index] = 1;
+    printf("%s: error: same file as %s\n", files[found[j].index],
+           files[found[first].index]);
+  }
+
+  int unique_count = 0;
+  for (int j = 0; j < file_count; j++) {
+    if (!repeated[j]) {
+      unique[unique_count++] = files[j];
+    }
+  }
+  free(found);
+  free(repeated);
+  return unique_count;
+}
+
+int editorScriptRun(char *path, char **files, int file_count) {
+  struct Script script;
+  if (editorScriptLoad(path, &script) == -1) {
+    return 1;
+  }
+
+  char **unique = malloc(sizeof(char *) * file_count);
+  int unique_count = editorScriptUniqueFiles(files, file_count, unique);
+
+  struct ScriptQueue queue;
+  queue.script = &script;
+  queue.files = unique;
+  queue.file_count = unique_count;
+  queue.next_file = 0;
+  queue.failures = file_count - unique_count;
+  pthread_mutex_init(&queue.lock, NULL);
+
+  // one worker per core, but no more workers than files
+  long worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+  if (worker_count < 1) {
+    worker_count = 1;
+  }
+  if (worker_count > unique_count) {
+    worker_count = unique_count;
+  }
+
+  pthread_t *workers = malloc(sizeof(pthread_t) * worker_count);
+  long started = 0;
+  while (started < worker_count &&
+         pthread_create(&workers[started], NULL, editorScriptWorker, &queue) ==
+             0) {
+    started++;
+  }
+  // if no thread could be started, do the work here
+  if (started == 0) {
+    editorScriptWorker(&queue);
+  }
+  for (long j = 0; j < started; j++) {
+    pthread_join(workers[j], NULL);
+  }
+
+  free(workers);
+  free(unique);
+  pthread_mutex_destroy(&queue.lock);
+  editorScriptFree(&script);
+  return queue.failures ? 1 : 0;
+}
@@ -0,0 +1,26 @@
+#ifndef script_h
+#define script_h
+
+// Batch mode: apply a script of edits to many files without a terminal, one
+// file per worker thread.
+//
+// A script is a text file with one command per line; blank lines and lines
+// starting with `#` are ignored. Lines and columns are 1-based, and TEXT may
+// use the escapes \n \r \t \e \\ and \xHH.
+//
+//   goto LINE [COLUMN]   move the cursor
+//   insert TEXT          type TEXT at the cursor
+//   backspace [N]        delete N characters before the cursor
+//   key NAME [N]         press a key N times: up, down, left, right, home,
+//                        end, pageup, pagedown, delete, backspace, enter or
+//                        ctrl-X; not ctrl-O or ctrl-B, since a script only
+//                        ever edits the one file
+//   keys TEXT            type raw keystrokes, escape sequences included
+//   save                 write the file
+
+// Apply the script at `path` to each of `files`, reporting each file's outcome
+// on stdout. Names for a file already given fail rather than being edited
+// twice at once. Returns the process exit status: 0 if every file succeeded.
+int editorScriptRun(char *path, char **files, int file_count);
+
+#endif
@@ -0,0 +1,327 @@
+#include "trace.h"
+#include "append-buffer.h"
+#include "editor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define KILO_TRACE_HEADER "kilo-trace 1 %d %d\n"
+// how much of a recording is kept in memory between writes
+#define KILO_TRACE_BUFFER (64 * 1024)
+
+struct TraceEvent {
+  // when the byte arrived, relative to the start of the recording
+  uint64_t time_us;
+  char byte;
+};
+
+struct EditorTrace {
+  // recording: where to write, and when recording started
+  FILE *record;
+  uint64_t start_ns;
+
+  // replaying: the events, and how far through them we are
+  struct TraceEvent *events;
+  int event_count;
+  int next_event;
+  int replaying;
+  int realtime;
+  // time spent sleeping to honour the original pace
+  uint64_t waited_ns;
+  // the directory holding the copies of the files a replay edits, and the
+  // copies themselves
+  char *copies_directory;
+  char **copies;
+  int copy_count;
+};
+
+_Thread_local struct EditorTrace trace = {NULL, 0, NULL, 0, 0,    0,
+                                          0,    0, NULL, NULL, 0};
+
+uint64_t editorTraceNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int editorTraceReadByte(char *c) {
+  if (!trace.replaying) {
+    int nread = (int)read(STDIN_FILENO, c, 1);
+    if (nread == 1 && trace.record) {
+      fprintf(trace.record, "%llu %d\n",
+              (unsigned long long)(editorTraceNow() - trace.start_ns) / 1000,
+              (unsigned char)*c);
+    }
+    return nread;
+  }
+
+  if (trace.next_event >= trace.event_count) {
+    return 0;
+  }
+  struct TraceEvent *event = &trace.events[trace.next_event++];
+
+  if (trace.realtime) {
+    uint64_t due = trace.start_ns + event->time_us * 1000;
+    uint64_t now = editorTraceNow();
+    if (due > now) {
+      struct timespec delay = {(time_t)((due - now) / 1000000000ULL),
+                               (long)((due - now) % 1000000000ULL)};
+      nanosleep(&delay, NULL);
+      trace.waited_ns += editorTraceNow() - now;
+    }
+  }
+
+  *c = event->byte;
+  return 1;
+}
+
+int editorTraceExhausted(void) {
+  return trace.replaying && trace.next_event >= trace.event_count;
+}
+
+int editorTraceRecord(char *path) {
+  trace.record = fopen(path, "w");
+  if (!trace.record) {
+    return -1;
+  }
+  // buffered, so recording doesn't add a write to every keypress it measures;
+  // the trace is flushed when it's closed, including by die()'s exit()
+  setvbuf(trace.record, NULL, _IOFBF, KILO_TRACE_BUFFER);
+  fprintf(trace.record, KILO_TRACE_HEADER, config.wsize.ws_row + 2,
+          config.wsize.ws_col);
+  trace.start_ns = editorTraceNow();
+  return 0;
+}
+
+void editorTraceClose(void) {
+  if (trace.record) {
+    fclose(trace.record);
+    trace.record = NULL;
+  }
+}
+
+int editorTraceLoad(char *path) {
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    return -1;
+  }
+
+  int rows, cols;
+  if (fscanf(fp, KILO_TRACE_HEADER, &rows, &cols) != 2 || rows < 3 ||
+      cols < 1) {
+    fclose(fp);
+    return -1;
+  }
+  // the same window as the recording, minus the status and message bars
+  config.wsize.ws_row = rows - 2;
+  config.wsize.ws_col = cols;
+
+  int capacity = 1024;
+  trace.events = malloc(sizeof(struct TraceEvent) * capacity);
+  trace.event_count = 0;
+
+  unsigned long long time_us;
+  int byte;
+  while (fscanf(fp, "%llu %d", &time_us, &byte) == 2) {
+    if (trace.event_count == capacity) {
+      capacity *= 2;
+      trace.events =
+          realloc(trace.events, sizeof(struct TraceEvent) * capacity);
+    }
+    trace.events[trace.event_count].time_us = time_us;
+    trace.events[trace.event_count].byte = (char)byte;
+    trace.event_count++;
+  }
+
+  fclose(fp);
+  return 0;
+}
+
+int compareTraceLatencies(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+void editorTracePrintPercentiles(const char *name, uint64_t *latencies,
+                                 int count) {
+  qsort(latencies, count, sizeof(uint64_t), compareTraceLatencies);
+  printf("\"%s_p50_ns\":%llu,\"%s_p90_ns\":%llu,\"%s_p99_ns\":%llu,"
+         "\"%s_max_ns\":%llu",
+         name, (unsigned long long)latencies[count * 50 / 100], name,
+         (unsigned long long)latencies[count * 90 / 100], name,
+         (unsigned long long)latencies[count * 99 / 100], name,
+         (unsigned long long)latencies[count - 1]);
+}
+
+int editorTraceReplay(char *path, int realtime) {
+  if (editorTraceLoad(path) == -1) {
+    return -1;
+  }
+  config.headless = 1;
+  trace.replaying = 1;
+  trace.realtime = realtime;
+  trace.next_event = 0;
+  trace.waited_ns = 0;
+
+  // every frame consumes at least one byte
+  uint64_t *process_ns = malloc(sizeof(uint64_t) * (trace.event_count + 1));
+  uint64_t *render_ns = malloc(sizeof(uint64_t) * (trace.event_count + 1));
+  uint64_t total_bytes = 0;
+  int frames = 0;
+  int running = 1;
+
+  trace.start_ns = editorTraceNow();
+  // frames are drawn through the same path as the live loop (which draws one
+  // before reading any input), so the perf stats count them too
+  editorRefreshScreen();
+  while (running && !editorTraceExhausted()) {
+    int first_event = trace.next_event;
+    uint64_t waited = trace.waited_ns;
+
+    uint64_t start = editorTraceNow();
+    running = editorProcessKeypress();
+    uint64_t processed = editorTraceNow();
+
+    int bytes = editorRefreshScreen();
+    uint64_t rendered = editorTraceNow();
+
+    process_ns[frames] = processed - start - (trace.waited_ns - waited);
+    render_ns[frames] = rendered - processed;
+    total_bytes += bytes;
+    printf("{\"frame\":%d,\"input_bytes\":%d,\"process_ns\":%llu,"
+           "\"render_ns\":%llu,\"output_bytes\":%d}\n",
+           frames, trace.next_event - first_event,
+           (unsigned long long)process_ns[frames],
+           (unsigned long long)render_ns[frames], bytes);
+    frames++;
+  }
+
+  uint64_t wall_ns = editorTraceNow() - trace.start_ns;
+  printf("{\"trace\":\"%s\",\"frames\":%d,\"input_bytes\":%d,"
+         "\"output_bytes\":%llu,\"wall_ns\":%llu",
+         path, frames, trace.next_event, (unsigned long long)total_bytes,
+         (unsigned long long)wall_ns);
+  if (frames > 0) {
+    printf(",");
+    editorTracePrintPercentiles("process", process_ns, frames);
+    printf(",");
+    editorTracePrintPercentiles("render", render_ns, frames);
+  }
+  printf("}\n");
+
+  free(process_ns);
+  free(render_ns);
+  free(trace.events);
+  trace.events = NULL;
+  trace.replaying = 0;
+  return 0;
+}
+
+// copy the file at `from` to a new file at `to`
+int editorTraceCopyFile(char *from, char *to) {
+  int in = open(from, O_RDONLY);
+  if (in == -1) {
+    return -1;
+  }
+  int out = open(to, O_WRONLY | O_CREAT | O_EXCL, 0600);
+  if (out == -1) {
+    close(in);
+    return -1;
+  }
+
+  char buffer[KILO_TRACE_BUFFER];
+  ssize_t length;
+  int result = 0;
+  while ((length = read(in, buffer, sizeof(buffer))) != 0) {
+    if (length == -1 && errno == EINTR) {
+      continue;
+    }
+    if (length == -1 || write(out, buffer, length) != length) {
+      result = -1;
+      break;
+    }
+  }
+  close(in);
+  if (close(out) == -1) {
+    result = -1;
+  }
+  return result;
+}
+
+int editorTraceCopyFiles(char **paths, int count) {
+  const char *temp = getenv("TMPDIR");
+  char directory[4096];
+  snprintf(directory, sizeof(directory), "%s/kilo-replay-XXXXXX",
+           temp && temp[0] ? temp : "/tmp");
+  if (mkdtemp(directory) == NULL) {
+    return -1;
+  }
+  trace.copies_directory = strdup(directory);
+  trace.copies = calloc(count + 1, sizeof(char *));
+
+  for (int j = 0; j < count; j++) {
+    // numbered, since files in different directories can share a name; the
+    // name is kept for the status bar
+    char *name = strrchr(paths[j], '/');
+    name = name ? name + 1 : paths[j];
+    char path[8192];
+    snprintf(path, sizeof(path), "%s/%d-%s", directory, j, name);
+    trace.copies[trace.copy_count++] = strdup(path);
+    // a file that doesn't exist yet is left for the replay to create
+    if (access(paths[j], F_OK) == 0 &&
+        editorTraceCopyFile(paths[j], path) == -1) {
+      return -1;
+    }
+    paths[j] = trace.copies[j];
+  }
+  return 0;
+}
+
+void editorTraceRemoveCopies(void) {
+  for (int j = 0; j < trace.copy_count; j++) {
+    unlink(trace.copies[j]);
+    free(trace.copies[j]);
+  }
+  free(trace.copies);
+  trace.copies = NULL;
+  trace.copy_count = 0;
+  if (trace.copies_directory) {
+    rmdir(trace.copies_directory);
+    free(trace.copies_directory);
+    trace.copies_directory = NULL;
+  }
+}
+
+int editorTraceFeed(const char *bytes, int length) {
+  struct TraceEvent *events = malloc(sizeof(struct TraceEvent) * (length + 1));
+  for (int j = 0; j < length; j++) {
+    events[j].time_us = 0;
+    events[j].byte = bytes[j];
+  }
+
+  trace.events = events;
+  trace.event_count = length;
+  trace.next_event = 0;
+  trace.replaying = 1;
+  trace.realtime = 0;
+
+  int running = 1;
+  while (running && !editorTraceExhausted()) {
+    running = editorProcessKeypress();
+    // nothing is drawn, but paging depends on where the screen would be
+    editorScroll();
+  }
+
+  free(events);
+  trace.events = NULL;
+  trace.event_count = 0;
+  trace.replaying = 0;
+  return running;
+}
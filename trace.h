@@ -0,0 +1,44 @@
+#ifndef trace_h
+#define trace_h
+
+// Recording keystrokes to a trace file and replaying them headlessly, so that
+// "it felt slow when I did X" can be turned into a repeatable performance test.
+//
+// A trace is a text file: a `kilo-trace 1 <rows> <cols>` header giving the
+// window size, then one `<microseconds since start> <byte>` line per byte read.
+
+// Like read(STDIN_FILENO, c, 1), but reads from the trace being replayed if
+// there is one, and records the byte if recording. Returns 0 if no byte is
+// available yet.
+int editorTraceReadByte(char *c);
+
+// Returns 1 once a replayed trace has run out of input.
+int editorTraceExhausted(void);
+
+// Start recording every byte read from the terminal to the trace at `path`.
+// Returns -1 if the trace can't be created.
+int editorTraceRecord(char *path);
+
+// Finish writing the trace being recorded, if any.
+void editorTraceClose(void);
+
+// Replay the trace at `path` into the current document without a terminal,
+// either as fast as possible or (if `realtime`) at the original pace. Frames
+// are drawn as in the live loop, just not written out. Prints a JSON line per
+// frame and a JSON summary to stdout. Returns -1 if the trace can't be read.
+int editorTraceReplay(char *path, int realtime);
+
+// Replays edit scratch copies of the files, so that saving leaves the real
+// ones alone and the replay can be repeated. Copy each of the `count` files in
+// `paths` to a new temporary directory, and point `paths` at the copies.
+// Returns -1 on error.
+int editorTraceCopyFiles(char **paths, int count);
+// Delete the copies, once the replay is over.
+void editorTraceRemoveCopies(void);
+
+// Feed `length` bytes of keystrokes to the current document as if typed, with
+// no terminal and no timing output. A prompt left waiting when the bytes run
+// out is cancelled. Returns 0 if the keystrokes quit the editor, 1 otherwise.
+int editorTraceFeed(const char *bytes, int length);
+
+#endif
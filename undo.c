@@ -0,0 +1,169 @@
+#include "undo.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct EditorUndo {
+  // the edit replaced rows [at, at + old_count) with `new_count` rows
+  int at;
+  int old_count;
+  int new_count;
+  // for bulk edits, new row j was old row source[j], or is new if that's -1;
+  // NULL when every new row is new
+  int *source;
+  // the old rows that are no longer in the document, in order
+  EditorRow *removed;
+  int removed_count;
+  // where the cursor was before the edit
+  int cx, cy;
+  // whether typing may extend this record
+  int open;
+};
+
+// what the record's rows count for in `undo_bytes`
+size_t editorUndoBytes(struct EditorUndo *record) {
+  size_t bytes = 0;
+  for (int j = 0; j < record->removed_count; j++) {
+    bytes += editorRowBytes(&record->removed[j]);
+  }
+  return bytes;
+}
+
+void editorUndoFree(struct EditorUndo *record) {
+  for (int j = 0; j < record->removed_count; j++) {
+    editorFreeRow(&record->removed[j]);
+  }
+  free(record->removed);
+  free(record->source);
+}
+
+struct EditorUndo *editorUndoPush(void) {
+  if (config.undo_count == KILO_UNDO_LIMIT) {
+    config.undo_bytes -= editorUndoBytes(&config.undo_records[0]);
+    editorUndoFree(&config.undo_records[0]);
+    memmove(&config.undo_records[0], &config.undo_records[1],
+            sizeof(struct EditorUndo) * (config.undo_count - 1));
+    config.undo_count--;
+  }
+  if (config.undo_count == config.undo_capacity) {
+    config.undo_capacity = config.undo_capacity ? config.undo_capacity * 2 : 16;
+    config.undo_records = realloc(
+        config.undo_records, sizeof(struct EditorUndo) * config.undo_capacity);
+  }
+
+  struct EditorUndo *record = &config.undo_records[config.undo_count++];
+  record->source = NULL;
+  record->removed = NULL;
+  record->removed_count = 0;
+  record->cx = config.cx;
+  record->cy = config.cy;
+  record->open = 0;
+  return record;
+}
+
+void editorUndoRecordEdit(int at, int old_count, int new_count) {
+  // still typing within the rows the last record covers: it already holds
+  // their original text, so only its extent changes
+  if (config.undo_count > 0) {
+    struct EditorUndo *last = &config.undo_records[config.undo_count - 1];
+    if (last->open && at >= last->at &&
+        at + old_count <= last->at + last->new_count) {
+      last->new_count += new_count - old_count;
+      return;
+    }
+  }
+
+  struct EditorUndo *record = editorUndoPush();
+  record->at = at;
+  record->old_count = old_count;
+  record->new_count = new_count;
+  record->open = 1;
+  if (old_count > 0) {
+    // the rows are shared rather than copied: typing unshares them before
+    // changing them, and undoing gives back rows that still know where they
+    // are in the file
+    record->removed = malloc(sizeof(EditorRow) * old_count);
+    for (int j = 0; j < old_count; j++) {
+      editorRowShare(&config.rows[at + j], &record->removed[j]);
+    }
+    record->removed_count = old_count;
+    config.undo_bytes += editorUndoBytes(record);
+  }
+}
+
+void editorUndoRecordRows(int at, int old_count, int *source, int new_count,
+                          EditorRow *removed, int removed_count) {
+  struct EditorUndo *record = editorUndoPush();
+  record->at = at;
+  record->old_count = old_count;
+  record->new_count = new_count;
+  record->source = source;
+  record->removed = removed;
+  record->removed_count = removed_count;
+  config.undo_bytes += editorUndoBytes(record);
+}
+
+int editorUndo(void) {
+  if (config.undo_count == 0) {
+    return 0;
+  }
+  struct EditorUndo *record = &config.undo_records[--config.undo_count];
+  config.undo_bytes -= editorUndoBytes(record);
+  // typing after an undo starts a record of its own, rather than extending
+  // the one before, whose rows are no longer the ones on screen
+  if (config.undo_count > 0) {
+    config.undo_records[config.undo_count - 1].open = 0;
+  }
+
+  EditorRow *old_rows = malloc(sizeof(EditorRow) * (record->old_count + 1));
+  if (record->source) {
+    // put the surviving rows back where they came from, drop the new ones,
+    // and fill the gaps with the removed ones
+    char *filled = calloc(record->old_count + 1, 1);
+    for (int j = 0; j < record->new_count; j++) {
+      if (record->source[j] == -1) {
+        editorFreeRow(&config.rows[record->at + j]);
+        continue;
+      }
+      old_rows[record->source[j]] = config.rows[record->at + j];
+      filled[record->source[j]] = 1;
+    }
+    for (int j = 0, k = 0; j < record->old_count; j++) {
+      if (!filled[j]) {
+        old_rows[j] = record->removed[k++];
+      }
+    }
+    free(filled);
+  } else {
+    for (int j = 0; j < record->new_count; j++) {
+      editorFreeRow(&config.rows[record->at + j]);
+    }
+    if (record->old_count > 0) {
+      memcpy(old_rows, record->removed, sizeof(EditorRow) * record->old_count);
+    }
+  }
+  editorSpliceRows(record->at, record->new_count, old_rows, record->old_count);
+  free(old_rows);
+
+  // the rows belong to the document again
+  free(record->removed);
+  free(record->source);
+
+  config.cy = record->cy < config.row_count ? record->cy : config.row_count;
+  int size = config.cy < config.row_count ? config.rows[config.cy].size : 0;
+  config.cx = record->cx < size ? record->cx : size;
+  return 1;
+}
+
+void editorUndoClearState(struct EditorConfig *state) {
+  for (int j = 0; j < state->undo_count; j++) {
+    editorUndoFree(&state->undo_records[j]);
+  }
+  free(state->undo_records);
+  state->undo_records = NULL;
+  state->undo_count = 0;
+  state->undo_capacity = 0;
+  state->undo_bytes = 0;
+}
+
+void editorUndoClear(void) { editorUndoClearState(&config); }
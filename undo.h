@@ -0,0 +1,35 @@
+#ifndef undo_h
+#define undo_h
+
+#include "editor.h"
+
+// Undoing edits, one group of rows at a time. Every edit replaces a run of
+// rows with another run; a record keeps what's needed to put the old run back.
+//
+// Typing keeps the rows it touches, sharing their text until it changes them,
+// and keeps extending the same record while it stays within those rows. Bulk
+// edits (line commands, cut and paste) keep the rows they took out, and where
+// each remaining row came from; no line is copied.
+
+// the most records kept per buffer; the oldest are forgotten first
+#define KILO_UNDO_LIMIT 1000
+
+// Call before typing replaces rows [at, at + old_count) with `new_count` rows.
+void editorUndoRecordEdit(int at, int old_count, int new_count);
+
+// Call when a bulk edit replaces rows [at, at + old_count) with `new_count`
+// rows. New row j is old row source[j], or is new if source[j] is -1; if
+// they're all new, `source` is NULL. The `removed_count` old rows that are
+// gone, in order, are given to the record, along with `source`.
+void editorUndoRecordRows(int at, int old_count, int *source, int new_count,
+                          EditorRow *removed, int removed_count);
+
+// Revert the most recent edit. Returns 0 if there was nothing to undo.
+int editorUndo(void);
+
+// Forget every record, e.g. when the document is replaced from disk.
+void editorUndoClear(void);
+// Forget every record of an inactive buffer's `state`.
+void editorUndoClearState(struct EditorConfig *state);
+
+#endif
@@ -31,6 +31,15 @@ struct TerminalCommand displayCursor() {
   return tc;
 }
 
+uint64_t hashBytes(const char *bytes, size_t length) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t j = 0; j < length; j++) {
+    hash ^= (unsigned char)bytes[j];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
 void die(const char *message) {
   clearDisplayForStandardOut();
   repositionCursorToTopLeft();
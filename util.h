@@ -1,6 +1,9 @@
 #ifndef util_h
 #define util_h
 
+#include <stddef.h>
+#include <stdint.h>
+
 struct TerminalCommand {
   char *string_representation;
   int length;
@@ -18,6 +21,18 @@ void repositionCursorToTopLeft(void);
 void hideCursorWhileWriting(void);
 void displayCursorAfterWriting(void);
 
+#pragma mark - Files and Hashing
+
+// the nanosecond part of a `struct stat` modification time
+#ifdef __APPLE__
+#define KILO_MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#else
+#define KILO_MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#endif
+
+// a fast, non-cryptographic 64-bit hash (FNV-1a) of `length` bytes.
+uint64_t hashBytes(const char *bytes, size_t length);
+
 #pragma mark - Error Handling
 
 // print an error message and exit with a non-zero status.
@@ -0,0 +1,237 @@
+#include "wrap.h"
+#include "editor-key.h"
+
+int editorWrapCount(EditorRow *row) {
+  int cols = config.wsize.ws_col;
+  return row->render_size > cols ? (row->render_size + cols - 1) / cols : 1;
+}
+
+// the index's summary of a run of rows is how many visual lines they take up
+void editorWrapSummarize(void *summary, int row) {
+  EditorRow *r = &config.rows[row];
+  r->wrap_count = editorWrapCount(r);
+  *(int *)summary = r->wrap_count;
+}
+
+void editorWrapCombine(void *into, const void *next) {
+  *(int *)into += *(const int *)next;
+}
+
+void editorWrapInit(void) {
+  editorRowTreeInit(&config.wrap_index, sizeof(int), editorWrapSummarize,
+                    editorWrapCombine);
+}
+
+// the index is only kept up to date while wrapping, at the width it was built
+// for; otherwise it's rebuilt before it's next used
+int editorWrapIndexCurrent(void) {
+  return config.wrap && editorRowTreeBuilt(&config.wrap_index) &&
+         config.wrap_cols == config.wsize.ws_col;
+}
+
+// rebuild the index from scratch; O(n) in the number of rows, but only reads
+// render sizes, never the text
+void editorWrapRebuild(void) {
+  config.wrap_cols = config.wsize.ws_col;
+  editorRowTreeBuild(&config.wrap_index, config.row_count);
+}
+
+// make sure the index describes the current rows at the current width
+void editorWrapEnsureIndex(void) {
+  if (!editorRowTreeBuilt(&config.wrap_index) ||
+      config.wrap_cols != config.wsize.ws_col) {
+    editorWrapRebuild();
+  }
+}
+
+void editorWrapRowsSpliced(int at, int remove_count, int add_count) {
+  if (editorWrapIndexCurrent()) {
+    editorRowTreeSplice(&config.wrap_index, at, remove_count, add_count);
+  }
+}
+
+void editorWrapRowUpdated(EditorRow *row) {
+  if (!editorWrapIndexCurrent() || row < config.rows ||
+      row >= config.rows + config.row_count) {
+    return;
+  }
+  editorRowTreeUpdate(&config.wrap_index, (int)(row - config.rows));
+}
+
+// how many visual lines come before row `at`
+int editorWrapLinesBefore(int at) {
+  struct RowTree *tree = &config.wrap_index;
+  int lines = 0;
+  int node = tree->root;
+  while (node) {
+    struct RowTreeNode *n = &tree->nodes[node];
+    int left_size = tree->nodes[n->left].size;
+    if (at <= left_size) {
+      node = n->left;
+      continue;
+    }
+    lines += *(int *)editorRowTreeSummary(tree, n->left) +
+             *(int *)editorRowTreeRowSummary(tree, node);
+    at -= left_size + 1;
+    node = n->right;
+  }
+  return lines;
+}
+
+// the row containing visual line `line`, and how many of that row's lines
+// precede it; past the end this is (row_count, lines past the end)
+int editorWrapFindLine(int line, int *segment) {
+  struct RowTree *tree = &config.wrap_index;
+  int row = 0;
+  int node = tree->root;
+  while (node) {
+    struct RowTreeNode *n = &tree->nodes[node];
+    int left_lines = *(int *)editorRowTreeSummary(tree, n->left);
+    if (line < left_lines) {
+      node = n->left;
+      continue;
+    }
+    line -= left_lines;
+    row += tree->nodes[n->left].size;
+    int own_lines = *(int *)editorRowTreeRowSummary(tree, node);
+    if (line < own_lines) {
+      *segment = line;
+      return row;
+    }
+    line -= own_lines;
+    row++;
+    node = n->right;
+  }
+  *segment = line;
+  return row;
+}
+
+void editorWrapToggle(void) {
+  config.wrap = !config.wrap;
+  if (config.wrap) {
+    editorWrapRebuild();
+    config.wrap_offset = editorWrapLinesBefore(config.row_offset);
+    config.col_offset = 0;
+  } else {
+    // it's rebuilt when wrapping is turned back on, rather than patched until
+    // then
+    editorRowTreeFree(&config.wrap_index);
+  }
+  // when turning wrapping off, row_offset is already the top row
+}
+
+// the screen line of the cursor within its row
+void editorWrapCursorPosition(int *line, int *column) {
+  editorWrapEnsureIndex();
+  int rx = 0;
+  int segment = 0;
+  if (config.cy < config.row_count) {
+    EditorRow *row = &config.rows[config.cy];
+    rx = editorRowCxToRx(row, config.cx);
+    segment = rx / config.wsize.ws_col;
+    if (segment >= row->wrap_count) {
+      // the end of a row that exactly fills its last line
+      segment = row->wrap_count - 1;
+    }
+  }
+  *line = editorWrapLinesBefore(config.cy) + segment;
+  *column = rx - segment * config.wsize.ws_col;
+  if (*column >= config.wsize.ws_col) {
+    *column = config.wsize.ws_col - 1;
+  }
+}
+
+void editorWrapScroll(void) {
+  config.rx = 0;
+  if (config.cy < config.row_count) {
+    config.rx = editorRowCxToRx(&config.rows[config.cy], config.cx);
+  }
+
+  int line, column;
+  editorWrapCursorPosition(&line, &column);
+  if (line < config.wrap_offset) {
+    config.wrap_offset = line;
+  }
+  if (line >= config.wrap_offset + config.wsize.ws_row) {
+    config.wrap_offset = line - config.wsize.ws_row + 1;
+  }
+
+  // keep the unwrapped view roughly in sync for when wrapping is turned off
+  int segment;
+  config.row_offset = editorWrapFindLine(config.wrap_offset, &segment);
+  config.col_offset = 0;
+}
+
+void editorWrapDrawRows(struct append_buffer *ab) {
+  editorWrapEnsureIndex();
+  int cols = config.wsize.ws_col;
+  int segment;
+  int filerow = editorWrapFindLine(config.wrap_offset, &segment);
+
+  for (int y = 0; y < config.wsize.ws_row; y++) {
+    if (filerow >= config.row_count) {
+      append_buffer_append(ab, "~", 1);
+    } else {
+      EditorRow *row = &config.rows[filerow];
+      int start = segment * cols;
+      int length = row->render_size - start;
+      if (length > cols) {
+        length = cols;
+      }
+      editorDrawRowSegment(ab, filerow, start, length);
+      if (++segment >= row->wrap_count) {
+        filerow++;
+        segment = 0;
+      }
+    }
+
+    append_buffer_append(ab, "\x1b[K", 3);
+    append_buffer_append(ab, "\r\n", 2);
+  }
+}
+
+// put the cursor on the given visual line, as close to `column` as possible
+void editorWrapMoveToLine(int line, int column) {
+  int segment;
+  config.cy = editorWrapFindLine(line, &segment);
+  if (config.cy >= config.row_count) {
+    config.cy = config.row_count;
+    config.cx = 0;
+    return;
+  }
+  EditorRow *row = &config.rows[config.cy];
+  config.cx = editorRowRxToCx(row, segment * config.wsize.ws_col + column);
+}
+
+void editorWrapMoveCursor(int keypress) {
+  int line, column;
+  editorWrapCursorPosition(&line, &column);
+  if (keypress == ARROW_UP && line > 0) {
+    editorWrapMoveToLine(line - 1, column);
+  } else if (keypress == ARROW_DOWN && config.cy < config.row_count) {
+    editorWrapMoveToLine(line + 1, column);
+  }
+}
+
+void editorWrapPage(int keypress) {
+  editorWrapEnsureIndex();
+  int line, column;
+  editorWrapCursorPosition(&line, &column);
+
+  int total = editorWrapLinesBefore(config.row_count);
+  int distance = keypress == PAGE_UP ? -config.wsize.ws_row
+                                     : config.wsize.ws_row;
+  line += distance;
+  if (line < 0) {
+    line = 0;
+  }
+  if (line > total) {
+    line = total;
+  }
+
+  config.wrap_offset += distance;
+  if (config.wrap_offset < 0) {
+    config.wrap_offset = 0;
+  }
+  editorWrapMoveToLine(line, column);
+}
@@ -0,0 +1,37 @@
+#ifndef wrap_h
+#define wrap_h
+
+#include "append-buffer.h"
+#include "editor.h"
+
+// Soft wrap: long rows continue onto the following screen lines instead of
+// scrolling horizontally. Screen ("visual") lines are located through an index
+// of how many lines each row wraps to (a row tree), so scrolling and paging
+// never rewrap the document. While wrapping, edits patch the index in
+// O(log n); it's only rebuilt when wrapping is turned on and when the window
+// is resized.
+
+// Set up the calling thread's (empty) index.
+void editorWrapInit(void);
+// Turn soft wrapping on or off.
+void editorWrapToggle(void);
+
+// Tell the index that rows [at, at + remove_count) were replaced with
+// `add_count` rows, which are now in place.
+void editorWrapRowsSpliced(int at, int remove_count, int add_count);
+// Tell the index that the contents of `row` changed.
+void editorWrapRowUpdated(EditorRow *row);
+
+// the visual line the cursor is on, and the column within it
+void editorWrapCursorPosition(int *line, int *column);
+
+// Keep the cursor on screen (like editorScroll) when wrapping.
+void editorWrapScroll(void);
+void editorWrapDrawRows(struct append_buffer *ab);
+
+// Move the cursor one visual line up or down.
+void editorWrapMoveCursor(int keypress);
+// Move the cursor, and the screen, a page up or down.
+void editorWrapPage(int keypress);
+
+#endif